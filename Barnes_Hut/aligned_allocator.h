@@ -0,0 +1,59 @@
+/*-------------aligned_allocator.h--------------------------------------------//
+*
+* Purpose: Allocator for std::vector that places data on cache line (64 byte)
+*          boundaries, so threads writing neighbouring blocks never share a
+*          cache line and SIMD loads are aligned
+*
+*-----------------------------------------------------------------------------*/
+
+#ifndef ALIGNED_ALLOCATOR_H
+#define ALIGNED_ALLOCATOR_H
+
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+const size_t CACHE_LINE = 64;
+
+template <typename T, size_t Alignment = CACHE_LINE>
+struct aligned_allocator {
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = aligned_allocator<U, Alignment>;
+    };
+
+    aligned_allocator() = default;
+
+    template <typename U>
+    aligned_allocator(const aligned_allocator<U, Alignment>&) {}
+
+    T* allocate(size_t n) {
+        void *ptr = nullptr;
+        if (posix_memalign(&ptr, Alignment, n * sizeof(T)) != 0) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(ptr);
+    }
+
+    void deallocate(T* ptr, size_t) {
+        free(ptr);
+    }
+};
+
+template <typename T, typename U, size_t A>
+bool operator==(const aligned_allocator<T, A>&, const aligned_allocator<U, A>&){
+    return true;
+}
+
+template <typename T, typename U, size_t A>
+bool operator!=(const aligned_allocator<T, A>&, const aligned_allocator<U, A>&){
+    return false;
+}
+
+// Shorthand for a cache line aligned std::vector
+template <typename T>
+using aligned_vector = std::vector<T, aligned_allocator<T>>;
+
+#endif
@@ -12,20 +12,45 @@
 *-----------------------------------------------------------------------------*/
 
 #include "barnes_hut.h"
+#include "checkpoint.h"
+#include "diagnostics.h"
+#include "integrator.h"
+#include "snapshot.h"
 
 /*----------------------------------------------------------------------------//
 * MAIN
 *-----------------------------------------------------------------------------*/
 
-int main(){
+// The MPI build and the benchmark link this file without its main
+#ifndef NO_MAIN
+// Usage: barnes_hut [checkpoint], a checkpoint file resumes that run
+int main(int argc, char **argv){
     // Defining file for output
     std::ofstream output("out.dat", std::ofstream::out);
     std::ofstream p_output("pout.dat", std::ofstream::out);
+    snapshot_writer snapshots("particles.snap");
+    checkpoint_options checkpoints("checkpoint.dat", 5);
+    diagnostics_stream energy("energy.dat", argc > 1);
+
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::vector<particle> p_vec;
+    integrator integ(integrator_type::rk4, 0.001);
+
+    if (argc > 1){
+        if (!load_checkpoint(argv[1], p_vec, integ, gen)){
+            std::cerr << "Cannot restart from " << argv[1] << '\n';
+            return 1;
+        }
+    }
+    else{
+        p_vec = create_rand_dist(1.0, 100, gen);
+    }
 
     // Creating the octree
-    std::vector<particle> p_vec = create_rand_dist(1.0, 100);
-    node *root = make_octree(p_vec);
-    divide_octree(root, 1);
+    octree tree;
+    node *root = make_octree(tree, p_vec);
+    divide_octree(tree, root, 1);
 
     // Show all particle positions
     particle_output(root, std::cout);
@@ -33,13 +58,49 @@ int main(){
 
     std::cout << "\n\n";
     p_output << "\n\n";
+    snapshots.write(p_vec, integ.time, integ.steps);
+
+    // Forces are found again at every stage, on the refitted tree. It is
+    // rebuilt after every checkpoint, so a restart sees the same tree. The
+    // potential for the diagnostics comes out of the same passes.
+    std::vector<double> pot;
+    force_fn force = octree_force(tree, 1, &pot);
+    if (argc > 1){
+        octree_potential(root, p_vec, pot);
+        tree.needs_rebuild = true;
+    }
+    else{
+        init_integrator(integ, p_vec, force);
+    }
+    energy.write(find_diagnostics(p_vec, pot, integ));
 
-    force_integrate(root, 0.001);
+    while (integ.steps < 10){
+        integrate_step(integ, p_vec, force);
+        snapshots.write(p_vec, integ.time, integ.steps);
+
+        // The last force pass of a step covers every particle
+        energy.write(find_diagnostics(p_vec, pot, integ));
+
+        if (checkpoint_due(checkpoints, integ)){
+            if (!save_checkpoint(checkpoints.path, p_vec, integ, gen)){
+                std::cerr << "Could not write checkpoint "
+                          << checkpoints.path << " at step " << integ.steps
+                          << '\n';
+            }
+            tree.needs_rebuild = true;
+        }
+    }
 
     particle_output(root, std::cout);
     particle_output(root, p_output);
     octree_output(root, output);
+
+    if (!snapshots.close()){
+        std::cerr << "Could not write all of particles.snap" << '\n';
+        return 1;
+    }
 }
+#endif
 
 /*----------------------------------------------------------------------------//
 * SUBROUTINES
@@ -47,13 +108,19 @@ int main(){
 
 // Function to create random distribution of particles for Octree
 std::vector<particle> create_rand_dist(double box_length, int pnum){
+    // Creating random device to place particles later
+    static std::random_device rd;
+    static std::mt19937 gen(rd());
+
+    return create_rand_dist(box_length, pnum, gen);
+}
+
+std::vector<particle> create_rand_dist(double box_length, int pnum,
+                                       std::mt19937 &gen){
     // Creating vector for particle positions (p_vec)
     std::vector<particle> p_vec;
     p_vec.reserve(pnum);
 
-    // Creating random device to place particles later
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
     std::uniform_real_distribution<double> 
         box_dist(-box_length * 0.5, box_length * 0.5);
 
@@ -66,38 +133,395 @@ std::vector<particle> create_rand_dist(double box_length, int pnum){
     return p_vec;
 }
 
-node* make_octree(std::vector<particle> &p_vec) {
-    auto root = new node();
-    root->p_vec.reserve(p_vec.size());
+// Function to create a Plummer sphere, truncated at 10 scale radii
+std::vector<particle> create_plummer_dist(double scale, int pnum,
+                                          std::mt19937 &gen){
+    std::vector<particle> p_vec;
+    p_vec.reserve(pnum);
+
+    // The enclosed mass fraction of radius r is (1 + a^2 / r^2)^(-3/2)
+    double max_fraction = pow(1 + 0.01, -1.5);
+    std::uniform_real_distribution<double> fraction(0.0, max_fraction);
+    std::uniform_real_distribution<double> cos_theta(-1.0, 1.0);
+    std::uniform_real_distribution<double> phi(0.0, 2 * M_PI);
 
+    for (int i = 0; i < pnum; ++i){
+        double r = scale / sqrt(pow(fraction(gen), -2.0 / 3.0) - 1);
+        double ct = cos_theta(gen);
+        double st = sqrt(1 - ct * ct);
+        double ph = phi(gen);
+        p_vec.emplace_back(vec(r * st * cos(ph), r * st * sin(ph), r * ct),
+                           vec(), vec(), PARTICLE_MASS);
+    }
+
+    return p_vec;
+}
+
+// Function to create clumps: small Plummer spheres at random places
+std::vector<particle> create_clustered_dist(double box_length, int pnum,
+                                            int clusters, std::mt19937 &gen){
+    std::vector<particle> centers = create_rand_dist(box_length, clusters,
+                                                     gen);
+    std::vector<particle> p_vec;
+    p_vec.reserve(pnum);
+
+    for (int c = 0; c < clusters; ++c){
+        int count = pnum / clusters + (c < pnum % clusters ? 1 : 0);
+        for (auto &part : create_plummer_dist(box_length * 0.02, count, gen)){
+            part.p += centers[c].p;
+            p_vec.push_back(part);
+        }
+    }
+
+    return p_vec;
+}
+
+node* make_octree(octree &tree, std::vector<particle> &p_vec) {
+    tree.arena.reset();
+    tree.root = node();
+    tree.needs_rebuild = false;
+    node *root = &tree.root;
+
+    tree.index.clear();
+    tree.index.reserve(p_vec.size());
     for (auto& p : p_vec) {
-        root->p_vec.push_back(&p);
+        tree.index.push_back(&p);
+        root->com.p += p.p * p.mass;
+        root->com.mass += p.mass;
     }
+    root->com.p /= root->com.mass;
+    root->p_vec = particle_range(tree.index.data(),
+                                 tree.index.data() + tree.index.size());
     return root;
 }
 
 // Function to create octree from vecition data
 // Initially, read in root node
-void divide_octree(node *curr, size_t box_threshold){
+void divide_octree(octree &tree, node *curr, size_t box_threshold){
 
     // Divide node into 8 subnodes (boxes) to work with
-    make_octchild(curr);
-    
+    make_octchild(tree.arena, curr);
+
+    particle **first = curr->p_vec.begin();
+    particle **last = curr->p_vec.end();
+
+    // Only the root can hold particles outside of its box, they are moved
+    // to the end of its range and given to no child
+    if (!curr->parent){
+        last = std::partition(first, last, [curr](particle *p){
+                   return in_box(curr, p);
+               });
+    }
+
+    // Splitting the range in place into the 8 children, by z, then y, then
+    // x. The split planes are the upper faces of the lower children, the
+    // same ones in_box checks against.
+    node *lower = curr->children[0];
+    double half_box = lower->box_length * 0.5;
+    double z_split = lower->p.z + half_box;
+    double y_split = lower->p.y + half_box;
+    double x_split = lower->p.x + half_box;
+
+    std::array<particle**, 9> bounds;
+    bounds[0] = first;
+    bounds[8] = last;
+    bounds[4] = std::partition(first, last, [z_split](particle *p){
+                    return p->p.z < z_split;
+                });
+    for (int n = 0; n < 8; n += 4){
+        bounds[n + 2] = std::partition(bounds[n], bounds[n + 4],
+                                       [y_split](particle *p){
+                            return p->p.y < y_split;
+                        });
+    }
+    for (int n = 0; n < 8; n += 2){
+        bounds[n + 1] = std::partition(bounds[n], bounds[n + 2],
+                                       [x_split](particle *p){
+                            return p->p.x < x_split;
+                        });
+    }
+
     // Iterating through all the children
-    for (auto &child : curr->children){
-        // Determine number of particles in our current box
-        for (auto p : curr->p_vec){
-            if (in_box(child, p)){
-                child->p_vec.push_back(p);
-                child->com.p += p->p * p->mass;
-                child->com.mass += p->mass;
-            }
+    for (int n = 0; n < 8; ++n){
+        node *child = curr->children[n];
+        child->p_vec = particle_range(bounds[n], bounds[n + 1]);
+        for (auto p : child->p_vec){
+            child->com.p += p->p * p->mass;
+            child->com.mass += p->mass;
         }
         child->com.p /= child->com.mass;
         if (child->p_vec.size() > box_threshold){
-            divide_octree(child, box_threshold);
+            divide_octree(tree, child, box_threshold);
+        }
+        else{
+            find_quadrupole(child);
+        }
+    }
+
+    // All children are done, so this is bottom-up
+    find_quadrupole(curr);
+}
+
+// Finds the quadrupole of a node from its children or particles
+void find_quadrupole(node *curr){
+    curr->quad = sym_tensor();
+
+    // Leaf node
+    if (!curr->children[0]){
+        for (auto p : curr->p_vec){
+            add_quadrupole(curr->quad, p->p - curr->com.p, p->mass);
+        }
+        return;
+    }
+
+    for (auto child : curr->children){
+        if (child->p_vec.empty()){
+            continue;
+        }
+        curr->quad += child->quad;
+        add_quadrupole(curr->quad, child->com.p - curr->com.p,
+                       child->com.mass);
+    }
+}
+
+// Center of mass of the particles held by a node
+static particle find_com(node *curr){
+    particle com(vec(), vec(), vec(), 0.0);
+    for (auto p : curr->p_vec){
+        com.p += p->p * p->mass;
+        com.mass += p->mass;
+    }
+    com.p /= com.mass;
+    return com;
+}
+
+// Gives the runs of all descendants of a node back to the arena
+static void release_subtree(node_arena &arena, node *curr){
+    if (!curr->children[0]){
+        return;
+    }
+
+    for (auto child : curr->children){
+        release_subtree(arena, child);
+    }
+    arena.release_children(curr->children[0]);
+    curr->children.fill(nullptr);
+}
+
+// Marks a node and all its ancestors dirty, stopping at the first ancestor
+// that is already marked (its path up is marked too)
+static void mark_dirty(node *curr){
+    while (curr && !curr->dirty){
+        curr->dirty = true;
+        curr = curr->parent;
+    }
+}
+
+// Brings a dirty subtree up to date, bottom-up: splits leaves that are now
+// too full, collapses nodes that are now too empty and finds com / quad.
+// Clean children are skipped, they are still correct.
+static void refit_node(octree &tree, node *curr, size_t box_threshold){
+    curr->dirty = false;
+
+    bool leaf = !curr->children[0];
+    if (!leaf && curr->p_vec.size() <= box_threshold){
+        release_subtree(tree.arena, curr);
+        leaf = true;
+    }
+    else if (leaf && curr->p_vec.size() > box_threshold){
+        divide_octree(tree, curr, box_threshold);
+        leaf = false;
+    }
+
+    if (leaf){
+        curr->com = find_com(curr);
+        find_quadrupole(curr);
+        return;
+    }
+
+    particle com(vec(), vec(), vec(), 0.0);
+    for (auto child : curr->children){
+        if (child->dirty){
+            refit_node(tree, child, box_threshold);
+        }
+        if (!child->p_vec.empty()){
+            com.p += child->com.p * child->com.mass;
+            com.mass += child->com.mass;
         }
     }
+    com.p /= com.mass;
+    curr->com = com;
+    find_quadrupole(curr);
+}
+
+// Child of curr that divide_octree would give p to, by the same split
+// planes. The faces of each child are rounded on their own, so a particle
+// can be in curr's box and still fail in_box for all 8 children.
+static node* child_holding(node *curr, particle *p){
+    node *lower = curr->children[0];
+    double half_box = lower->box_length * 0.5;
+    int n = 4 * (p->p.z >= lower->p.z + half_box)
+            + 2 * (p->p.y >= lower->p.y + half_box)
+            + (p->p.x >= lower->p.x + half_box);
+    return curr->children[n];
+}
+
+// Moves the particles that left their leaf and updates com along the dirty
+// paths. The resulting tree is the same one divide_octree would build, up
+// to the order of particles within a leaf.
+bool refit_octree(octree &tree, size_t box_threshold, double max_migration){
+    node *root = &tree.root;
+
+    std::vector<node*> leaves;
+    traverse_post_order(root, [&leaves](node *curr){
+        if (!curr->children[0]){
+            leaves.push_back(curr);
+        }
+    });
+
+    // Particles that are no longer in the box of their leaf
+    std::vector<std::pair<node*, particle*>> migrants;
+    size_t in_leaves = 0;
+    bool escaped = false;
+    for (auto leaf : leaves){
+        in_leaves += leaf->p_vec.size();
+        for (auto p : leaf->p_vec){
+            if (!in_box(leaf, p)){
+                migrants.emplace_back(leaf, p);
+                escaped = escaped || !in_box(root, p);
+            }
+        }
+    }
+
+    // Particles outside of the root box are only held by the root, so they
+    // could never be found again if they came back. Only a rebuild can
+    // place them.
+    if (escaped || in_leaves != root->p_vec.size()
+        || migrants.size() > max_migration * root->p_vec.size()){
+        return false;
+    }
+
+    // Going up from the old leaf until a box holds the particle again, and
+    // back down into the new leaf. Both paths are dirty.
+    std::vector<std::pair<node*, particle*>> arrivals;
+    for (auto &migrant : migrants){
+        node *curr = migrant.first;
+        particle *p = migrant.second;
+        while (!in_box(curr, p)){
+            mark_dirty(curr);
+            curr = curr->parent;
+        }
+
+        while (curr->children[0]){
+            curr = child_holding(curr, p);
+        }
+        mark_dirty(curr);
+        arrivals.emplace_back(curr, p);
+    }
+    std::sort(arrivals.begin(), arrivals.end());
+
+    // Leaves are in the same order as their ranges, so the new index is
+    // written leaf by leaf: the particles that stayed, then the new ones.
+    // Only dirty leaves can have lost or gained any.
+    tree.scratch.resize(tree.index.size());
+    particle **out = tree.scratch.data();
+    for (auto leaf : leaves){
+        particle **first = out;
+        if (!leaf->dirty){
+            out = std::copy(leaf->p_vec.begin(), leaf->p_vec.end(), out);
+        }
+        else{
+            for (auto p : leaf->p_vec){
+                if (in_box(leaf, p)){
+                    *out++ = p;
+                }
+            }
+            auto it = std::lower_bound(arrivals.begin(), arrivals.end(),
+                                       std::make_pair(leaf,
+                                                      (particle*)nullptr));
+            for (; it != arrivals.end() && it->first == leaf; ++it){
+                *out++ = it->second;
+            }
+        }
+        leaf->p_vec = particle_range(first, out);
+    }
+
+    // Every internal node spans its children
+    traverse_post_order(root, [](node *curr){
+        if (curr->children[0]){
+            curr->p_vec = particle_range(curr->children[0]->p_vec.first,
+                                         curr->children[7]->p_vec.last);
+        }
+    });
+    tree.index.swap(tree.scratch);
+
+    // Leaves whose particles moved have a new com, so their paths are dirty
+    for (auto leaf : leaves){
+        if (leaf->dirty){
+            continue;
+        }
+        particle com = find_com(leaf);
+        if (com.mass != leaf->com.mass
+            || (com.mass > 0 && (com.p.x != leaf->com.p.x
+                                 || com.p.y != leaf->com.p.y
+                                 || com.p.z != leaf->com.p.z))){
+            mark_dirty(leaf);
+        }
+    }
+
+    if (root->dirty){
+        refit_node(tree, root, box_threshold);
+    }
+
+    return true;
+}
+
+// Refits the octree, or rebuilds it if refit_octree refuses
+node* update_octree(octree &tree, std::vector<particle> &p_vec,
+                    size_t box_threshold){
+    if (refit_octree(tree, box_threshold, REBUILD_FRACTION)){
+        return &tree.root;
+    }
+
+    node *root = make_octree(tree, p_vec);
+    divide_octree(tree, root, box_threshold);
+    return root;
+}
+
+node* node_arena::alloc_children(){
+    node *children;
+    if (!free_runs.empty()){
+        children = free_runs.back();
+        free_runs.pop_back();
+    }
+    else{
+        if (used == ARENA_BLOCK){
+            ++block;
+            used = 0;
+        }
+        if (block == blocks.size()){
+            blocks.emplace_back(new node[ARENA_BLOCK]);
+        }
+        children = &blocks[block][used];
+        used += 8;
+    }
+
+    // Runs are reused, so whatever the last tree left in them goes
+    for (size_t i = 0; i < 8; ++i){
+        children[i] = node();
+    }
+    return children;
+}
+
+void node_arena::release_children(node *children){
+    free_runs.push_back(children);
+}
+
+// Blocks are kept, so the next tree of about the same size allocates nothing
+void node_arena::reset(){
+    block = 0;
+    used = 0;
+    free_runs.clear();
 }
 
 // Function to check whether a vecition is within a box
@@ -112,9 +536,10 @@ bool in_box(node *curr, particle *p){
 }
 
 // Function to create 8 children node for octree
-void make_octchild(node *curr){
+void make_octchild(node_arena &arena, node *curr){
     double node_length = curr->box_length * 0.5;
     double quarter_box = curr->box_length * 0.25;
+    node *run = arena.alloc_children();
 
     // iterating through vecsible locations for new children nodes
     // This was written by laurensbl
@@ -122,7 +547,7 @@ void make_octchild(node *curr){
         for (int j = -1; j <= 1; j += 2){
             for (int i = -1; i <= 1; i +=2){
                 int n = 2 * k + j + (i+1)/2 + 3;
-                curr->children[n] = new node();
+                curr->children[n] = run + n;
                 curr->children[n]->parent = curr;
                 curr->children[n]->box_length = node_length;
                 curr->children[n]->p.z = curr->p.z + k * quarter_box;
@@ -242,30 +667,55 @@ void force_integrate(node *root, double dt){
 }
 
 // Recursive function to find acceleration of particle in tree
-void RKsearch(node *curr, particle *part){
+void RKsearch(node *curr, particle *part, double *pot){
 
-    if (!curr){
+    if (!curr || curr->p_vec.empty()){
         return;
     }
 
     // Defining a few variables, distance and inverse_r (save those divisions)
-    vec d = curr->p - part->p;
+    vec d = curr->com.p - part->p;
     double inverse_r = 1/length(d);
 
     // Defining new theta of current node
     double theta_2 = curr->box_length * inverse_r;
 
     // find the new acceleration due to the current node
+    // A node holding the particle itself is always opened
+    if (theta_2 <= THETA && !in_box(curr, part)){
+        // The opening test uses the true distance, the force a softened one
+        double inverse_rs = 1 / sqrt(dot(d, d) + SOFTENING * SOFTENING);
 
-    if (theta_2 <= THETA){
         //double acc = G * curr.com.mass * inverse_r * inverse_r;
         // a = GM/r^2 * norm(r)
-        part->acc += d*(G * curr->com.mass * inverse_r * inverse_r * inverse_r);
+        part->acc += d * (G * curr->com.mass * inverse_rs * inverse_rs
+                          * inverse_rs);
+        part->acc += quadrupole_acc(curr->quad, d, inverse_rs);
+        if (pot){
+            *pot += -G * curr->com.mass * inverse_rs
+                    + quadrupole_pot(curr->quad, d, inverse_rs);
+        }
+    }
+    // Leaf node (bucket), so sum over its particles directly
+    else if (!curr->children[0]){
+        for (auto p : curr->p_vec){
+            if (p == part){
+                continue;
+            }
+            vec d_p = p->p - part->p;
+            double inverse_r_p = 1 / sqrt(dot(d_p, d_p)
+                                          + SOFTENING * SOFTENING);
+            part->acc += d_p * (G * p->mass * inverse_r_p * inverse_r_p
+                                  * inverse_r_p);
+            if (pot){
+                *pot -= G * p->mass * inverse_r_p;
+            }
+        }
     }
     // if above thresh THETA, then search again.
     else{
         for (auto child : curr->children){
-            RKsearch(child, part);
+            RKsearch(child, part, pot);
         }
     }
     
@@ -9,10 +9,12 @@
 
 #include <iostream>
 #include <cstdio> // For printf (which should replace iostream)
+#include <algorithm>
 #include <vector>
 #include <array>
 #include <random>
 #include <fstream>
+#include <memory>
 #include "vec.h"
 
 /*----------------------------------------------------------------------------//
@@ -21,7 +23,17 @@
 
 const double PARTICLE_MASS = 1E10;
 const double G = 6.67408E-11;
-const double THETA = 0.5;
+// Nodes carry quadrupoles, which gives the error monopoles had at 0.5
+const double THETA = 0.7;
+
+// Plummer softening length of the tree forces (both octrees, the periodic
+// walk and the distributed one), 1 / r becomes 1 / sqrt(r^2 + SOFTENING^2)
+// so close pairs cannot blow up a step. direct_force takes its own.
+const double SOFTENING = 0.01;
+
+// Fraction of particles changing leaves above which update_octree gives up
+// on refitting and rebuilds the tree from scratch
+const double REBUILD_FRACTION = 0.1;
 
 // Struct for Center of mass
 struct particle{
@@ -35,6 +47,87 @@ struct particle{
         : p(p), vel(v), acc(a), mass(m), radius(0.0) {}
 };
 
+// Symmetric 3x3 tensor, used for quadrupole moments and tidal tensors
+struct sym_tensor {
+    double xx, xy, xz, yy, yz, zz;
+
+    sym_tensor() : xx(0), xy(0), xz(0), yy(0), yz(0), zz(0) {}
+
+    sym_tensor& operator+=(const sym_tensor &rhs) {
+        xx += rhs.xx;
+        xy += rhs.xy;
+        xz += rhs.xz;
+        yy += rhs.yy;
+        yz += rhs.yz;
+        zz += rhs.zz;
+        return *this;
+    }
+};
+
+inline vec operator*(const sym_tensor &t, vec v) {
+    return vec(t.xx * v.x + t.xy * v.y + t.xz * v.z,
+               t.xy * v.x + t.yy * v.y + t.yz * v.z,
+               t.xz * v.x + t.yz * v.y + t.zz * v.z);
+}
+
+// Adds the traceless quadrupole m * (3 s s - s^2 I) of a point mass at
+// offset s from the center of mass. Used both for particles in a leaf and
+// for whole children (parallel axis theorem) when building bottom-up.
+inline void add_quadrupole(sym_tensor &quad, vec s, double m) {
+    double s2 = dot(s, s);
+    quad.xx += m * (3 * s.x * s.x - s2);
+    quad.xy += m * 3 * s.x * s.y;
+    quad.xz += m * 3 * s.x * s.z;
+    quad.yy += m * (3 * s.y * s.y - s2);
+    quad.yz += m * 3 * s.y * s.z;
+    quad.zz += m * (3 * s.z * s.z - s2);
+}
+
+// Acceleration due to a quadrupole, on top of the monopole term
+// d points from the particle to the center of mass
+inline vec quadrupole_acc(const sym_tensor &quad, vec d, double inverse_r) {
+    double inverse_r2 = inverse_r * inverse_r;
+    double inverse_r5 = inverse_r2 * inverse_r2 * inverse_r;
+    vec qd = quad * d;
+    return G * inverse_r5 * (2.5 * dot(d, qd) * inverse_r2 * d - qd);
+}
+
+// Potential due to a quadrupole, on top of the monopole -G M / r
+inline double quadrupole_pot(const sym_tensor &quad, vec d, double inverse_r) {
+    double inverse_r2 = inverse_r * inverse_r;
+    double inverse_r5 = inverse_r2 * inverse_r2 * inverse_r;
+    return -0.5 * G * inverse_r5 * dot(d, quad * d);
+}
+
+// Range of particles in the shared index buffer of an octree
+// Children split the range of their parent, so no node owns a list
+struct particle_range {
+    particle **first, **last;
+
+    particle_range() : first(nullptr), last(nullptr) {}
+    particle_range(particle **f, particle **l) : first(f), last(l) {}
+
+    particle** begin() const {
+        return first;
+    }
+
+    particle** end() const {
+        return last;
+    }
+
+    size_t size() const {
+        return last - first;
+    }
+
+    bool empty() const {
+        return first == last;
+    }
+
+    particle* operator[](size_t i) const {
+        return first[i];
+    }
+};
+
 // struct for octree nodes
 struct node {
     // Position of node / box
@@ -49,35 +142,113 @@ struct node {
 
     particle com;
 
+    // Quadrupole moment around com.p
+    sym_tensor quad;
+
     // Positions of all particles in box
-    std::vector<particle*> p_vec;
+    particle_range p_vec;
+
+    // Set during a refit for nodes whose particles or com changed
+    bool dirty;
  
     node() : p(0, 0, 0), box_length(1.0),
              parent(nullptr), children{nullptr},
-             com(vec(), vec(), vec(), 0.0) {}
+             com(vec(), vec(), vec(), 0.0), dirty(false) {}
 
     node(vec loc, double length, node *par) : 
         p(loc), box_length(length),
         parent(par), children{nullptr}, 
-        com(vec(), vec(), vec(),0.0) {}
+        com(vec(), vec(), vec(),0.0), dirty(false) {}
+};
+
+// Number of nodes in each block allocated by node_arena
+const size_t ARENA_BLOCK = 8 * 512;
+
+// Pool for octree nodes. The 8 children of a node are always handed out
+// together as one contiguous run, and the whole pool is rewound in O(1)
+// between steps instead of deleting the tree node by node.
+struct node_arena {
+    std::vector<std::unique_ptr<node[]>> blocks;
+
+    // Block currently handed out from and the nodes already used in it
+    size_t block, used;
+
+    // Runs of 8 given back by a refit, reused before the blocks
+    std::vector<node*> free_runs;
+
+    node_arena() : block(0), used(0) {}
+
+    // Returns 8 default constructed nodes, contiguous in memory
+    node* alloc_children();
+
+    // Gives back a run from alloc_children (not its children's runs)
+    void release_children(node *children);
+
+    // Forgets every node at once, keeping the memory for the next tree
+    void reset();
+};
+
+// Octree with the storage of its nodes and particle lists. Nodes point at
+// the root and at each other, so the struct itself must stay in place.
+struct octree {
+    node root;
+    node_arena arena;
+
+    // Every particle, ordered so each node's particles are contiguous
+    std::vector<particle*> index;
+
+    // Second buffer for refit_octree, swapped with index
+    std::vector<particle*> scratch;
 
-    ~node();
+    // Makes the next octree_force call rebuild instead of refit. The tree
+    // stays valid (and walkable) until then.
+    bool needs_rebuild;
+
+    octree() : needs_rebuild(false) {}
+    octree(const octree&) = delete;
+    octree& operator=(const octree&) = delete;
 };
 
 // Function to create random distribution of particles for Octree
 std::vector<particle> create_rand_dist(double box_length, int pnum);
 
+// Same, drawing from the given generator so a run can be reproduced
+std::vector<particle> create_rand_dist(double box_length, int pnum,
+                                       std::mt19937 &gen);
+
+// Function to create a Plummer sphere of scale radius scale
+std::vector<particle> create_plummer_dist(double scale, int pnum,
+                                          std::mt19937 &gen);
+
+// Function to create clusters (small Plummer spheres) spread over a box
+std::vector<particle> create_clustered_dist(double box_length, int pnum,
+                                            int clusters, std::mt19937 &gen);
+
 // Creates the root node for an octree, given a list of particles and maxim
-node* make_octree(std::vector<particle> &particles);
+// Any previous tree held by the octree is dropped
+node* make_octree(octree &tree, std::vector<particle> &particles);
 
 // Divides an octree node if 
-void divide_octree(node *curr, size_t box_threshold);
+void divide_octree(octree &tree, node *curr, size_t box_threshold);
+
+// Finds the quadrupole of a node from its children, or its particles if it
+// is a leaf. Children must already have theirs.
+void find_quadrupole(node *curr);
+
+// Moves the particles that left their leaf and updates com / quad along the
+// dirty paths only. Returns false, leaving the tree as it was, if more than
+// max_migration of the particles changed leaves.
+bool refit_octree(octree &tree, size_t box_threshold, double max_migration);
+
+// Refits the octree, or rebuilds it if refit_octree refuses
+node* update_octree(octree &tree, std::vector<particle> &p_vec,
+                    size_t box_threshold);
 
 // Function to check whether a particle is within a box
 bool in_box(node *curr, particle *p);
 
 // Function to create 8 children node for octree
-void make_octchild(node *curr);
+void make_octchild(node_arena &arena, node *curr);
 
 // Function to perform a depth first search of octree
 void depth_first_search(node *curr);
@@ -94,10 +265,13 @@ void particle_output(node *curr, std::ostream &p_output);
 void force_integrate(node *root, double dt);
 
 // Recursive function to find acceleration of particle in tree
-void RKsearch(node *curr, particle *part);
+// If pot is given, the potential at the particle is added to it as well
+void RKsearch(node *curr, particle *part, double *pot = nullptr);
 
 // Actual implementation of Runge-Kutta 4 method
 // Note: It's assumed that all particles have already updated their acc.
+// Every stage uses that same acc, so this is only first order, see
+// integrator.h for the versions that find the force again at each stage.
 void RK4(particle *part, double dt);
 
 // Traverses the tree in a post-order manner, executing the function given
@@ -115,8 +289,4 @@ void traverse_post_order(node* curr, const T& fn) {
     fn(curr);
 }
 
-inline node::~node() {
-    traverse_post_order(this, [](node* node) { delete node; });
-}
-
 #endif
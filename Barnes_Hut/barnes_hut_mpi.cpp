@@ -0,0 +1,57 @@
+/*------------barnes_hut_mpi.cpp----------------------------------------------//
+*
+* Purpose: Distributed memory version of the Barnes Hut simulation, each MPI
+*          rank holds the particles of its ORB box only
+*
+*   Notes: build with make mpi, run with
+*              mpirun -np 4 ./barnes_hut_mpi
+*          Several ranks on one machine work the same as separate nodes
+*
+*-----------------------------------------------------------------------------*/
+
+#include "distributed.h"
+
+/*----------------------------------------------------------------------------//
+* MAIN
+*-----------------------------------------------------------------------------*/
+
+int main(int argc, char **argv){
+    MPI_Init(&argc, &argv);
+
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    // Rank 0 makes all particles, the first exchange spreads them out
+    std::vector<particle> p_vec;
+    if (rank == 0){
+        std::mt19937 gen(1);
+        p_vec = create_rand_dist(1.0, 10000, gen);
+    }
+
+    orb_domain domain;
+    orb_decompose(MPI_COMM_WORLD, p_vec, domain);
+    exchange_particles(MPI_COMM_WORLD, domain, p_vec);
+
+    linear_octree tree;
+    force_fn force = mpi_force(MPI_COMM_WORLD, tree, LEAF_BUCKET);
+    integrator integ(integrator_type::leapfrog, 0.001);
+    init_integrator(integ, p_vec, force);
+
+    // Particles carry their acc, so they can change ranks between steps
+    while (integ.steps < 10){
+        integrate_step(integ, p_vec, force);
+        orb_decompose(MPI_COMM_WORLD, p_vec, domain);
+        exchange_particles(MPI_COMM_WORLD, domain, p_vec);
+    }
+
+    unsigned long long local = p_vec.size(), total;
+    MPI_Reduce(&local, &total, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0,
+               MPI_COMM_WORLD);
+    std::cout << "rank " << rank << ": " << local << " particles\n";
+    if (rank == 0){
+        std::cout << total << " particles after " << integ.steps
+                  << " steps\n";
+    }
+
+    MPI_Finalize();
+}
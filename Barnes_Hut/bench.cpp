@@ -0,0 +1,175 @@
+/*------------bench.cpp-------------------------------------------------------//
+*
+* Purpose: Benchmark for the linear octree. Times the build and the force
+*          pass, counts the work per particle and measures the force error
+*          against direct summation, sweeping THETA and the bucket size
+*
+*   Notes: build with make bench, run with
+*              ./bench [largest N]
+*          N goes from 1e3 up by factors of 10 (1e6 by default). One line
+*          per run, columns as in the header, so gnuplot can plot e.g.
+*          error against force time straight from the output.
+*
+*-----------------------------------------------------------------------------*/
+
+#include <chrono>
+#include <cstdlib>
+#include "direct.h"
+#include "linear_octree.h"
+
+/*----------------------------------------------------------------------------//
+* STRUCTS
+*-----------------------------------------------------------------------------*/
+
+// Particles checked against direct summation in every run
+const size_t ERROR_SAMPLES = 1000;
+
+// Runs are repeated until they take this long, so small N time well
+const double MIN_BENCH_TIME = 0.2;
+
+struct bench_result {
+    // Seconds per build and per force pass
+    double build, force;
+
+    // Kernel evaluations (particles and multipoles) per particle
+    double interactions;
+
+    // RMS of the force error over the RMS force
+    double rms_error;
+};
+
+/*----------------------------------------------------------------------------//
+* SUBROUTINES
+*-----------------------------------------------------------------------------*/
+
+static double seconds_since(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                         - start).count();
+}
+
+// Direct sum for a sample of the particles, the reference for rms_error.
+// Softened like the tree, so only the tree's own error is measured.
+static std::vector<vec> sample_acc(std::vector<particle> &p_vec,
+                                   const std::vector<size_t> &sample){
+    force_fn direct = direct_force(SOFTENING);
+    direct(p_vec, sample);
+
+    std::vector<vec> acc(sample.size());
+    for (size_t s = 0; s < sample.size(); ++s){
+        acc[s] = p_vec[sample[s]].acc;
+    }
+
+    return acc;
+}
+
+// Kernel evaluations per particle, from the interaction lists of the
+// leaves. Padding of the near list is counted, the kernel does that work.
+static double interactions_per_particle(const linear_octree &tree){
+    double total = 0;
+
+    #pragma omp parallel reduction(+:total)
+    {
+        interaction_list list;
+        multipole_list far;
+
+        #pragma omp for schedule(dynamic, 4)
+        for (size_t l = 0; l < tree.leaves.size(); ++l){
+            const lnode &leaf = tree.nodes[tree.leaves[l]];
+            leaf_interactions(tree, tree.leaves[l], list, far);
+            total += (double)(leaf.end - leaf.begin)
+                     * (list.size() + far.size());
+        }
+    }
+
+    return total / std::max(tree.index.size(), (size_t)1);
+}
+
+static bench_result run(std::vector<particle> &p_vec, double theta,
+                        size_t bucket, const std::vector<size_t> &sample,
+                        const std::vector<vec> &reference){
+    bench_result result;
+    linear_octree tree;
+    tree.theta = theta;
+    fit_linear_octree(tree, p_vec);
+
+    size_t reps = 0;
+    auto start = std::chrono::steady_clock::now();
+    do {
+        make_linear_octree(tree, p_vec, bucket);
+        ++reps;
+    } while (seconds_since(start) < MIN_BENCH_TIME);
+    result.build = seconds_since(start) / reps;
+
+    reps = 0;
+    start = std::chrono::steady_clock::now();
+    do {
+        for (auto &part : p_vec){
+            part.acc = vec();
+        }
+        parallel_force(tree, p_vec);
+        ++reps;
+    } while (seconds_since(start) < MIN_BENCH_TIME);
+    result.force = seconds_since(start) / reps;
+
+    result.interactions = interactions_per_particle(tree);
+
+    double error = 0, norm = 0;
+    for (size_t s = 0; s < sample.size(); ++s){
+        vec d = p_vec[sample[s]].acc - reference[s];
+        error += dot(d, d);
+        norm += dot(reference[s], reference[s]);
+    }
+    result.rms_error = sqrt(error / norm);
+
+    return result;
+}
+
+/*----------------------------------------------------------------------------//
+* MAIN
+*-----------------------------------------------------------------------------*/
+
+int main(int argc, char **argv){
+    double max_n = argc > 1 ? atof(argv[1]) : 1e6;
+
+    const char *names[3] = {"uniform", "plummer", "clustered"};
+    const double thetas[] = {0.3, 0.5, 0.7, 0.9};
+    const size_t buckets[] = {4, 8, 32, 64};
+
+    printf("# %-9s %9s %5s %6s %11s %11s %11s %11s\n", "dist", "N", "theta",
+           "bucket", "build_s", "force_s", "inter/part", "rms_err");
+
+    for (int dist = 0; dist < 3; ++dist){
+        for (double n = 1e3; n <= max_n * 1.0001; n *= 10){
+            int pnum = (int)n;
+            std::mt19937 gen(dist * 1000 + pnum);
+            std::vector<particle> p_vec
+                = dist == 0 ? create_rand_dist(1.0, pnum, gen)
+                : dist == 1 ? create_plummer_dist(0.1, pnum, gen)
+                : create_clustered_dist(1.0, pnum, 32, gen);
+
+            std::vector<size_t> sample;
+            size_t stride = std::max(p_vec.size() / ERROR_SAMPLES, (size_t)1);
+            for (size_t i = 0; i < p_vec.size(); i += stride){
+                sample.push_back(i);
+            }
+            std::vector<vec> reference = sample_acc(p_vec, sample);
+
+            auto report = [&](double theta, size_t bucket){
+                bench_result result = run(p_vec, theta, bucket, sample,
+                                          reference);
+                printf("  %-9s %9d %5.2f %6zu %11.4e %11.4e %11.1f %11.4e\n",
+                       names[dist], pnum, theta, bucket, result.build,
+                       result.force, result.interactions, result.rms_error);
+                fflush(stdout);
+            };
+
+            // THETA sweep at the default bucket, then buckets at THETA
+            for (double theta : thetas){
+                report(theta, LEAF_BUCKET);
+            }
+            for (size_t bucket : buckets){
+                report(THETA, bucket);
+            }
+        }
+    }
+}
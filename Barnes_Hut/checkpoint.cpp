@@ -0,0 +1,222 @@
+/*-------------checkpoint.cpp-------------------------------------------------//
+*
+* Purpose: Checkpoint / restart for long Barnes Hut runs
+*
+*   Notes: The body is built in memory and written in one go, the header
+*          holds its size and CRC so a damaged file is never loaded
+*
+*-----------------------------------------------------------------------------*/
+
+#include <cstring>
+#include <sstream>
+#include <unistd.h>
+#include <zlib.h>
+#include "checkpoint.h"
+
+/*----------------------------------------------------------------------------//
+* SUBROUTINES
+*-----------------------------------------------------------------------------*/
+
+template <typename T>
+static void put(std::vector<char> &body, const T &value){
+    const char *bytes = reinterpret_cast<const char*>(&value);
+    body.insert(body.end(), bytes, bytes + sizeof(T));
+}
+
+// Reads the next value of the body, false if it runs past the end
+template <typename T>
+static bool get(const std::vector<char> &body, size_t &offset, T &value){
+    if (offset + sizeof(T) > body.size()){
+        return false;
+    }
+    memcpy(&value, &body[offset], sizeof(T));
+    offset += sizeof(T);
+    return true;
+}
+
+static void put_vec(std::vector<char> &body, vec v){
+    put(body, v.x);
+    put(body, v.y);
+    put(body, v.z);
+}
+
+static bool get_vec(const std::vector<char> &body, size_t &offset, vec &v){
+    return get(body, offset, v.x) && get(body, offset, v.y)
+           && get(body, offset, v.z);
+}
+
+// Function to check whether a checkpoint is due after the current step
+bool checkpoint_due(const checkpoint_options &opt, const integrator &integ){
+    return opt.interval > 0 && integ.steps > 0
+           && integ.steps % opt.interval == 0;
+}
+
+bool save_checkpoint(const std::string &path,
+                     const std::vector<particle> &p_vec,
+                     const integrator &integ, const std::mt19937 &gen){
+    std::vector<char> body;
+
+    // Integrator
+    put(body, (int32_t)integ.type);
+    put(body, integ.dt);
+    put(body, integ.eta);
+    put(body, integ.length);
+    put(body, (int32_t)integ.max_bin);
+    put(body, integ.time);
+    put(body, (uint64_t)integ.steps);
+    put(body, (uint64_t)integ.force_evals);
+    put(body, (uint64_t)integ.bins.size());
+    for (auto bin : integ.bins){
+        put(body, (int32_t)bin);
+    }
+
+    // Particles
+    put(body, (uint64_t)p_vec.size());
+    for (auto &part : p_vec){
+        put_vec(body, part.p);
+        put_vec(body, part.vel);
+        put_vec(body, part.acc);
+        put(body, part.mass);
+        put(body, part.radius);
+    }
+
+    // Random generator, in the text form the standard defines for it
+    std::ostringstream rng;
+    rng << gen;
+    std::string state = rng.str();
+    put(body, (uint64_t)state.size());
+    body.insert(body.end(), state.begin(), state.end());
+
+    checkpoint_header header;
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.reserved = 0;
+    header.body_size = body.size();
+    header.crc = crc32(0L, (const Bytef*)body.data(), body.size());
+
+    std::string tmp = path + ".tmp";
+    FILE *file = fopen(tmp.c_str(), "wb");
+    if (!file){
+        return false;
+    }
+
+    // On disk before the rename, or a crash soon after could leave an empty
+    // file under the final name
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+              && fwrite(body.data(), 1, body.size(), file) == body.size()
+              && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = (fclose(file) == 0) && ok;
+
+    if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0){
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool load_checkpoint(const std::string &path, std::vector<particle> &p_vec,
+                     integrator &integ, std::mt19937 &gen){
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file){
+        return false;
+    }
+
+    // The body is the rest of the file, checked before anything is
+    // allocated for it
+    long file_size = -1;
+    if (fseek(file, 0, SEEK_END) == 0){
+        file_size = ftell(file);
+    }
+    rewind(file);
+
+    checkpoint_header header;
+    std::vector<char> body;
+    bool ok = file_size >= (long)sizeof(header)
+              && fread(&header, sizeof(header), 1, file) == 1
+              && memcmp(header.magic, CHECKPOINT_MAGIC,
+                        sizeof(header.magic)) == 0
+              && header.version == CHECKPOINT_VERSION
+              && header.body_size == (uint64_t)file_size - sizeof(header);
+    if (ok){
+        body.resize(header.body_size);
+        ok = fread(body.data(), 1, body.size(), file) == body.size();
+    }
+    fclose(file);
+
+    if (!ok || header.crc != crc32(0L, (const Bytef*)body.data(),
+                                   body.size())){
+        return false;
+    }
+
+    // Read into copies first, so a bad body leaves the run untouched
+    size_t offset = 0;
+    integrator loaded(integrator_type::leapfrog, 0.0);
+    int32_t type, max_bin;
+    uint64_t steps, force_evals, n_bins;
+
+    ok = get(body, offset, type) && get(body, offset, loaded.dt)
+         && get(body, offset, loaded.eta) && get(body, offset, loaded.length)
+         && get(body, offset, max_bin) && get(body, offset, loaded.time)
+         && get(body, offset, steps) && get(body, offset, force_evals)
+         && get(body, offset, n_bins);
+    // Bins are shifts of the tick count, so they are checked as carefully
+    // as the sizes
+    if (!ok || n_bins > body.size()
+        || (type != (int32_t)integrator_type::leapfrog
+            && type != (int32_t)integrator_type::rk4
+            && type != (int32_t)integrator_type::block)
+        || max_bin < 0 || max_bin > MAX_TIME_BIN){
+        return false;
+    }
+
+    loaded.type = (integrator_type)type;
+    loaded.max_bin = max_bin;
+    loaded.steps = steps;
+    loaded.force_evals = force_evals;
+    loaded.bins.resize(n_bins);
+    for (auto &bin : loaded.bins){
+        int32_t value;
+        if (!get(body, offset, value) || value < 0 || value > max_bin){
+            return false;
+        }
+        bin = value;
+    }
+
+    uint64_t n_parts;
+    if (!get(body, offset, n_parts) || n_parts > body.size()){
+        return false;
+    }
+
+    // One bin per particle, none unless the integrator is block
+    if (n_bins != n_parts
+        && (n_bins != 0 || loaded.type == integrator_type::block)){
+        return false;
+    }
+
+    std::vector<particle> parts(n_parts);
+    for (auto &part : parts){
+        if (!get_vec(body, offset, part.p) || !get_vec(body, offset, part.vel)
+            || !get_vec(body, offset, part.acc)
+            || !get(body, offset, part.mass)
+            || !get(body, offset, part.radius)){
+            return false;
+        }
+    }
+
+    uint64_t state_size;
+    if (!get(body, offset, state_size)
+        || offset + state_size != body.size()){
+        return false;
+    }
+    std::istringstream rng(std::string(body.data() + offset, state_size));
+    std::mt19937 loaded_gen;
+    rng >> loaded_gen;
+    if (rng.fail()){
+        return false;
+    }
+
+    integ = loaded;
+    p_vec.swap(parts);
+    gen = loaded_gen;
+    return true;
+}
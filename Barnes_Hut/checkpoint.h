@@ -0,0 +1,62 @@
+/*-------------checkpoint.h---------------------------------------------------//
+*
+* Purpose: Header file for checkpoint.cpp, saves everything a run needs to
+*          carry on from where it stopped
+*
+*   Notes: A checkpoint holds the particles, the integrator (with the time
+*          bins and acc, so no force pass is needed on restart) and the
+*          random generator. Doubles are stored as they are in memory, so a
+*          restart continues bit for bit as long as the force routine sees
+*          the same tree, see octree_force.
+*
+*-----------------------------------------------------------------------------*/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <string>
+#include "barnes_hut.h"
+#include "integrator.h"
+
+/*----------------------------------------------------------------------------//
+* STRUCTS
+*-----------------------------------------------------------------------------*/
+
+const char CHECKPOINT_MAGIC[8] = {'B', 'H', 'C', 'H', 'K', 'P', 'T', 0};
+const uint32_t CHECKPOINT_VERSION = 1;
+
+struct checkpoint_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+
+    // Size and CRC-32 of everything after the header
+    uint64_t body_size;
+    uint64_t crc;
+};
+
+struct checkpoint_options {
+    std::string path;
+
+    // Steps between checkpoints, 0 turns them off
+    size_t interval;
+
+    checkpoint_options(const std::string &file, size_t every)
+        : path(file), interval(every) {}
+};
+
+// Function to check whether a checkpoint is due after the current step
+bool checkpoint_due(const checkpoint_options &opt, const integrator &integ);
+
+// Writes a checkpoint to a temporary file and renames it over path, so an
+// old checkpoint is only replaced by a complete one
+bool save_checkpoint(const std::string &path,
+                     const std::vector<particle> &p_vec,
+                     const integrator &integ, const std::mt19937 &gen);
+
+// Restores a checkpoint, returns false (changing nothing) if the file is
+// missing, from another version or damaged
+bool load_checkpoint(const std::string &path, std::vector<particle> &p_vec,
+                     integrator &integ, std::mt19937 &gen);
+
+#endif
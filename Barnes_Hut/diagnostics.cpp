@@ -0,0 +1,113 @@
+/*-------------diagnostics.cpp------------------------------------------------//
+*
+* Purpose: Energy and momentum diagnostics, with the potential energy from
+*          the octree instead of a sum over all pairs
+*
+*-----------------------------------------------------------------------------*/
+
+#include "diagnostics.h"
+
+/*----------------------------------------------------------------------------//
+* SUBROUTINES
+*-----------------------------------------------------------------------------*/
+
+diagnostics_stream::diagnostics_stream(const std::string &path, bool append)
+    : has_initial(false), initial_energy(0.0) {
+
+    // The first line that is not a comment holds the reference energy
+    if (append){
+        FILE *old = fopen(path.c_str(), "r");
+        char line[512];
+        while (old && fgets(line, sizeof(line), old)){
+            size_t step;
+            double time, kinetic, potential, energy;
+            if (line[0] == '#'){
+                continue;
+            }
+            if (sscanf(line, "%zu %lf %lf %lf %lf", &step, &time, &kinetic,
+                       &potential, &energy) == 5){
+                initial_energy = energy;
+                has_initial = true;
+            }
+            break;
+        }
+        if (old){
+            fclose(old);
+        }
+    }
+
+    file = fopen(path.c_str(), append ? "a" : "w");
+    if (file && !append){
+        fprintf(file, "# %7s %13s %13s %13s %13s %11s %11s %11s %11s %11s "
+                "%11s %11s\n", "step", "time", "kinetic", "potential",
+                "energy", "drift", "px", "py", "pz", "Lx", "Ly", "Lz");
+    }
+}
+
+diagnostics_stream::~diagnostics_stream(){
+    if (file){
+        fclose(file);
+    }
+}
+
+void diagnostics_stream::write(const diagnostics &diag){
+    if (!file){
+        return;
+    }
+
+    if (!has_initial){
+        initial_energy = diag.energy();
+        has_initial = true;
+    }
+    double drift = initial_energy != 0.0
+                   ? (diag.energy() - initial_energy) / fabs(initial_energy)
+                   : 0.0;
+
+    fprintf(file, "  %7zu %13.6e %13.6e %13.6e %13.6e %11.3e %11.3e %11.3e "
+            "%11.3e %11.3e %11.3e %11.3e\n", diag.step, diag.time,
+            diag.kinetic, diag.potential, diag.energy(), drift,
+            diag.momentum.x, diag.momentum.y, diag.momentum.z,
+            diag.angular_momentum.x, diag.angular_momentum.y,
+            diag.angular_momentum.z);
+    fflush(file);
+}
+
+// Function to find the potential of every particle from the octree
+void octree_potential(node *root, std::vector<particle> &p_vec,
+                      std::vector<double> &pot){
+    pot.assign(p_vec.size(), 0.0);
+
+    // RKsearch skips the particle itself by address, so the walk has to be
+    // on p_vec itself. The acceleration it finds on the way is dropped.
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (size_t i = 0; i < p_vec.size(); ++i){
+        particle *part = &p_vec[i];
+        vec acc = part->acc;
+        part->acc = vec();
+        RKsearch(root, part, &pot[i]);
+        part->acc = acc;
+    }
+}
+
+// Function to find energy and momenta, pot as octree_force finds it
+diagnostics find_diagnostics(const std::vector<particle> &p_vec,
+                             const std::vector<double> &pot,
+                             const integrator &integ){
+    diagnostics diag;
+    diag.time = integ.time;
+    diag.step = integ.steps;
+
+    // Each pair is in two potentials, hence the 0.5
+    double kinetic = 0, potential = 0;
+    for (size_t i = 0; i < p_vec.size(); ++i){
+        const particle &part = p_vec[i];
+        kinetic += 0.5 * part.mass * dot(part.vel, part.vel);
+        potential += 0.5 * part.mass * pot[i];
+        diag.momentum += part.mass * part.vel;
+        diag.angular_momentum += part.mass * cross(part.p, part.vel);
+    }
+    diag.kinetic = kinetic;
+    diag.potential = potential;
+
+    return diag;
+}
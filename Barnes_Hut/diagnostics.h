@@ -0,0 +1,73 @@
+/*-------------diagnostics.h--------------------------------------------------//
+*
+* Purpose: Header file for diagnostics.cpp, energy, momentum and angular
+*          momentum of the system, written once per step to a text stream
+*
+*   Notes: The potential comes from the octree walk of RKsearch, found by
+*          octree_force alongside the accelerations, so it costs nothing
+*          extra and carries the tree's error, about the same relative error
+*          as the forces at THETA. Every integrator ends a step with a pass
+*          over all particles, so it always matches the positions.
+*
+*-----------------------------------------------------------------------------*/
+
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <string>
+#include "barnes_hut.h"
+#include "integrator.h"
+
+/*----------------------------------------------------------------------------//
+* STRUCTS
+*-----------------------------------------------------------------------------*/
+
+struct diagnostics {
+    double time;
+    size_t step;
+
+    double kinetic, potential;
+
+    // Both about the origin
+    vec momentum, angular_momentum;
+
+    double energy() const {
+        return kinetic + potential;
+    }
+};
+
+// One line per write, columns as in the header. The drift column is
+// relative to the first energy of the file, so a restart carries on with
+// the reference of the run it continues.
+struct diagnostics_stream {
+    // append continues an existing file (after a restart) without a header,
+    // taking the reference energy from its first line
+    diagnostics_stream(const std::string &path, bool append = false);
+    ~diagnostics_stream();
+
+    diagnostics_stream(const diagnostics_stream&) = delete;
+    diagnostics_stream& operator=(const diagnostics_stream&) = delete;
+
+    bool is_open() const {
+        return file != nullptr;
+    }
+
+    void write(const diagnostics &diag);
+
+    FILE *file;
+    bool has_initial;
+    double initial_energy;
+};
+
+// Function to find the potential of every particle from the octree, for
+// when there was no force pass to find it (straight after a restart). root
+// must hold the current positions. acc is kept.
+void octree_potential(node *root, std::vector<particle> &p_vec,
+                      std::vector<double> &pot);
+
+// Function to find energy and momenta, pot as octree_force finds it
+diagnostics find_diagnostics(const std::vector<particle> &p_vec,
+                             const std::vector<double> &pot,
+                             const integrator &integ);
+
+#endif
@@ -0,0 +1,305 @@
+/*-------------direct.cpp-----------------------------------------------------//
+*
+* Purpose: Direct summation of the gravitational forces, cache blocked and
+*          vectorized, with AVX2 / AVX-512 tile kernels picked at runtime
+*
+*   Notes: Like the p2p kernels, the AVX2 estimate goes through single
+*          precision, so r^2 + softening^2 has to fit in a float.
+*
+*-----------------------------------------------------------------------------*/
+
+#include <immintrin.h>
+#include "direct.h"
+
+/*----------------------------------------------------------------------------//
+* SUBROUTINES
+*-----------------------------------------------------------------------------*/
+
+// Positions and masses of a list of particles as SoA
+struct direct_arrays {
+    aligned_vector<double> x, y, z, mass;
+
+    void resize(size_t n){
+        x.resize(n);
+        y.resize(n);
+        z.resize(n);
+        mass.resize(n);
+    }
+
+    void set(size_t i, const particle &part){
+        x[i] = part.p.x;
+        y[i] = part.p.y;
+        z[i] = part.p.z;
+        mass[i] = part.mass;
+    }
+};
+
+// Tile kernel: adds sum m d / (r^2 + eps2)^(3/2) from sources [0, ns) to
+// (ax, ay, az)[0, nt), without G. Same shape as the p2p kernels, but with
+// softening, no padding and Newton steps up to full double precision.
+using direct_fn = void (*)(const double *tx, const double *ty,
+                           const double *tz, size_t nt, const double *sx,
+                           const double *sy, const double *sz,
+                           const double *sm, size_t ns, double eps2,
+                           double *ax, double *ay, double *az);
+
+static void direct_scalar(const double *tx, const double *ty,
+                          const double *tz, size_t nt, const double *sx,
+                          const double *sy, const double *sz,
+                          const double *sm, size_t ns, double eps2,
+                          double *ax, double *ay, double *az){
+
+    for (size_t i = 0; i < nt; ++i){
+        double acc_x = 0, acc_y = 0, acc_z = 0;
+        for (size_t j = 0; j < ns; ++j){
+            double dx = sx[j] - tx[i];
+            double dy = sy[j] - ty[i];
+            double dz = sz[j] - tz[i];
+            double r2 = dx * dx + dy * dy + dz * dz;
+            if (r2 == 0.0){
+                continue;
+            }
+            double inverse_r = 1 / sqrt(r2 + eps2);
+            double f = sm[j] * inverse_r * inverse_r * inverse_r;
+            acc_x += dx * f;
+            acc_y += dy * f;
+            acc_z += dz * f;
+        }
+        ax[i] += acc_x;
+        ay[i] += acc_y;
+        az[i] += acc_z;
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static double hsum(__m256d v){
+    __m128d lo = _mm256_castpd256_pd128(v);
+    __m128d hi = _mm256_extractf128_pd(v, 1);
+    lo = _mm_add_pd(lo, hi);
+    return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+__attribute__((target("avx2,fma")))
+static void direct_avx2(const double *tx, const double *ty,
+                        const double *tz, size_t nt, const double *sx,
+                        const double *sy, const double *sz,
+                        const double *sm, size_t ns, double eps2,
+                        double *ax, double *ay, double *az){
+
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d three_halves = _mm256_set1_pd(1.5);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d soft = _mm256_set1_pd(eps2);
+    size_t ns_simd = ns - ns % 4;
+
+    for (size_t i = 0; i < nt; ++i){
+        __m256d px = _mm256_set1_pd(tx[i]);
+        __m256d py = _mm256_set1_pd(ty[i]);
+        __m256d pz = _mm256_set1_pd(tz[i]);
+        __m256d acc_x = zero, acc_y = zero, acc_z = zero;
+
+        for (size_t j = 0; j < ns_simd; j += 4){
+            __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(sx + j), px);
+            __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(sy + j), py);
+            __m256d dz = _mm256_sub_pd(_mm256_loadu_pd(sz + j), pz);
+            __m256d r2 = _mm256_mul_pd(dx, dx);
+            r2 = _mm256_fmadd_pd(dy, dy, r2);
+            r2 = _mm256_fmadd_pd(dz, dz, r2);
+            __m256d s2 = _mm256_add_pd(r2, soft);
+
+            // 12-bit estimate, three Newton steps take it to ~1e-16
+            __m256d half_s2 = _mm256_mul_pd(half, s2);
+            __m256d y = _mm256_cvtps_pd(_mm_rsqrt_ps(_mm256_cvtpd_ps(s2)));
+            for (int step = 0; step < 3; ++step){
+                __m256d y2 = _mm256_mul_pd(y, y);
+                y = _mm256_mul_pd(y, _mm256_fnmadd_pd(half_s2, y2,
+                                                      three_halves));
+            }
+
+            __m256d valid = _mm256_cmp_pd(r2, zero, _CMP_GT_OQ);
+            __m256d f = _mm256_mul_pd(_mm256_mul_pd(y, y), y);
+            f = _mm256_and_pd(valid,
+                              _mm256_mul_pd(f, _mm256_loadu_pd(sm + j)));
+
+            acc_x = _mm256_fmadd_pd(dx, f, acc_x);
+            acc_y = _mm256_fmadd_pd(dy, f, acc_y);
+            acc_z = _mm256_fmadd_pd(dz, f, acc_z);
+        }
+
+        ax[i] += hsum(acc_x);
+        ay[i] += hsum(acc_y);
+        az[i] += hsum(acc_z);
+    }
+
+    // The last few sources, not a multiple of 4
+    direct_scalar(tx, ty, tz, nt, sx + ns_simd, sy + ns_simd, sz + ns_simd,
+                  sm + ns_simd, ns - ns_simd, eps2, ax, ay, az);
+}
+
+// Plain horizontal sum, _mm512_reduce_add_pd trips -Wmaybe-uninitialized
+__attribute__((target("avx512f")))
+static double hsum(__m512d v){
+    alignas(64) double lanes[8];
+    _mm512_store_pd(lanes, v);
+    return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3]))
+           + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+}
+
+__attribute__((target("avx512f")))
+static void direct_avx512(const double *tx, const double *ty,
+                          const double *tz, size_t nt, const double *sx,
+                          const double *sy, const double *sz,
+                          const double *sm, size_t ns, double eps2,
+                          double *ax, double *ay, double *az){
+
+    const __m512d half = _mm512_set1_pd(0.5);
+    const __m512d three_halves = _mm512_set1_pd(1.5);
+    const __m512d zero = _mm512_setzero_pd();
+    const __m512d soft = _mm512_set1_pd(eps2);
+
+    for (size_t i = 0; i < nt; ++i){
+        __m512d px = _mm512_set1_pd(tx[i]);
+        __m512d py = _mm512_set1_pd(ty[i]);
+        __m512d pz = _mm512_set1_pd(tz[i]);
+        __m512d acc_x = zero, acc_y = zero, acc_z = zero;
+
+        for (size_t j = 0; j < ns; j += 8){
+            // The tail is loaded masked, its lanes get no mass
+            __mmask8 load = ns - j >= 8 ? 0xff : (1 << (ns - j)) - 1;
+            __m512d dx = _mm512_sub_pd(_mm512_maskz_loadu_pd(load, sx + j),
+                                       px);
+            __m512d dy = _mm512_sub_pd(_mm512_maskz_loadu_pd(load, sy + j),
+                                       py);
+            __m512d dz = _mm512_sub_pd(_mm512_maskz_loadu_pd(load, sz + j),
+                                       pz);
+            __m512d r2 = _mm512_mul_pd(dx, dx);
+            r2 = _mm512_fmadd_pd(dy, dy, r2);
+            r2 = _mm512_fmadd_pd(dz, dz, r2);
+            __m512d s2 = _mm512_add_pd(r2, soft);
+
+            // 14-bit estimate, two Newton steps take it to ~1e-16
+            __m512d half_s2 = _mm512_mul_pd(half, s2);
+            __m512d y = _mm512_maskz_rsqrt14_pd(0xff, s2);
+            for (int step = 0; step < 2; ++step){
+                __m512d y2 = _mm512_mul_pd(y, y);
+                y = _mm512_mul_pd(y, _mm512_fnmadd_pd(half_s2, y2,
+                                                      three_halves));
+            }
+
+            __mmask8 valid = _mm512_cmp_pd_mask(r2, zero, _CMP_GT_OQ) & load;
+            __m512d f = _mm512_mul_pd(_mm512_mul_pd(y, y), y);
+            f = _mm512_maskz_mul_pd(valid, f,
+                                    _mm512_maskz_loadu_pd(load, sm + j));
+
+            acc_x = _mm512_fmadd_pd(dx, f, acc_x);
+            acc_y = _mm512_fmadd_pd(dy, f, acc_y);
+            acc_z = _mm512_fmadd_pd(dz, f, acc_z);
+        }
+
+        ax[i] += hsum(acc_x);
+        ay[i] += hsum(acc_y);
+        az[i] += hsum(acc_z);
+    }
+}
+
+// Function to pick the widest kernel the running CPU supports
+static direct_fn select_direct_kernel(){
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")){
+        return direct_avx512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")){
+        return direct_avx2;
+    }
+    return direct_scalar;
+}
+
+// Adds the force of the sources to the targets, tile by tile
+void direct_sum(const double *tx, const double *ty, const double *tz,
+                size_t nt, const double *sx, const double *sy,
+                const double *sz, const double *sm, size_t ns,
+                double softening, double *ax, double *ay, double *az){
+
+    static const direct_fn kernel = select_direct_kernel();
+    double eps2 = softening * softening;
+    size_t n_tiles = (nt + DIRECT_TILE_I - 1) / DIRECT_TILE_I;
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (size_t tile = 0; tile < n_tiles; ++tile){
+        size_t i_begin = tile * DIRECT_TILE_I;
+        size_t i_end = std::min(i_begin + DIRECT_TILE_I, nt);
+
+        double acc_x[DIRECT_TILE_I] = {0};
+        double acc_y[DIRECT_TILE_I] = {0};
+        double acc_z[DIRECT_TILE_I] = {0};
+
+        for (size_t j_begin = 0; j_begin < ns; j_begin += DIRECT_TILE_J){
+            size_t j_end = std::min(j_begin + DIRECT_TILE_J, ns);
+            kernel(tx + i_begin, ty + i_begin, tz + i_begin, i_end - i_begin,
+                   sx + j_begin, sy + j_begin, sz + j_begin, sm + j_begin,
+                   j_end - j_begin, eps2, acc_x, acc_y, acc_z);
+        }
+
+        for (size_t i = i_begin; i < i_end; ++i){
+            ax[i] += G * acc_x[i - i_begin];
+            ay[i] += G * acc_y[i - i_begin];
+            az[i] += G * acc_z[i - i_begin];
+        }
+    }
+}
+
+// Function to add the acceleration of every particle from all the others
+void direct_acc(std::vector<particle> &p_vec, double softening){
+    size_t n = p_vec.size();
+
+    direct_arrays src;
+    src.resize(n);
+    for (size_t i = 0; i < n; ++i){
+        src.set(i, p_vec[i]);
+    }
+
+    aligned_vector<double> ax(n, 0.0), ay(n, 0.0), az(n, 0.0);
+    direct_sum(src.x.data(), src.y.data(), src.z.data(), n,
+               src.x.data(), src.y.data(), src.z.data(), src.mass.data(), n,
+               softening, ax.data(), ay.data(), az.data());
+
+    for (size_t i = 0; i < n; ++i){
+        p_vec[i].acc += vec(ax[i], ay[i], az[i]);
+    }
+}
+
+void direct_acc(particle_soa &parts, double softening){
+    size_t n = parts.size();
+    direct_sum(parts.x.data(), parts.y.data(), parts.z.data(), n,
+               parts.x.data(), parts.y.data(), parts.z.data(),
+               parts.mass.data(), n, softening,
+               parts.ax.data(), parts.ay.data(), parts.az.data());
+}
+
+// Force routine for the integrators, sums over all particles for each
+// active one
+force_fn direct_force(double softening){
+    return [softening](std::vector<particle> &p_vec,
+                       const std::vector<size_t> &active){
+        direct_arrays src, dst;
+        src.resize(p_vec.size());
+        for (size_t i = 0; i < p_vec.size(); ++i){
+            src.set(i, p_vec[i]);
+        }
+        dst.resize(active.size());
+        for (size_t a = 0; a < active.size(); ++a){
+            dst.set(a, p_vec[active[a]]);
+        }
+
+        size_t n = active.size();
+        aligned_vector<double> ax(n, 0.0), ay(n, 0.0), az(n, 0.0);
+        direct_sum(dst.x.data(), dst.y.data(), dst.z.data(), n,
+                   src.x.data(), src.y.data(), src.z.data(),
+                   src.mass.data(), p_vec.size(), softening,
+                   ax.data(), ay.data(), az.data());
+
+        for (size_t a = 0; a < n; ++a){
+            p_vec[active[a]].acc = vec(ax[a], ay[a], az[a]);
+        }
+    };
+}
@@ -0,0 +1,47 @@
+/*-------------direct.h-------------------------------------------------------//
+*
+* Purpose: Header file for direct.cpp, exact O(N^2) summation of the forces.
+*          The reference the tree is checked against, and faster than the
+*          tree for small N (below a few thousand particles).
+*
+*   Notes: Targets and sources are cut into tiles, so a tile of sources
+*          stays in L1 while every target of a tile goes over it. The tile
+*          kernels start from the rsqrt estimate like the p2p kernels, but
+*          take enough Newton steps to be exact to double rounding.
+*
+*-----------------------------------------------------------------------------*/
+
+#ifndef DIRECT_H
+#define DIRECT_H
+
+#include "aligned_allocator.h"
+#include "integrator.h"
+#include "particle_soa.h"
+
+/*----------------------------------------------------------------------------//
+* STRUCTS
+*-----------------------------------------------------------------------------*/
+
+// Targets per tile, one tile is one task for a thread
+const size_t DIRECT_TILE_I = 64;
+
+// Sources per tile, 4 arrays of 512 doubles (16 kB) fit in L1
+const size_t DIRECT_TILE_J = 512;
+
+// Adds G * sum m d / (r^2 + softening^2)^(3/2) over all sources to the
+// acceleration of every target. Sources at r = 0 (the target itself) are
+// skipped, softening = 0 is plain Newtonian gravity.
+void direct_sum(const double *tx, const double *ty, const double *tz,
+                size_t nt, const double *sx, const double *sy,
+                const double *sz, const double *sm, size_t ns,
+                double softening, double *ax, double *ay, double *az);
+
+// Function to add the acceleration of every particle from all the others
+void direct_acc(std::vector<particle> &p_vec, double softening = 0.0);
+void direct_acc(particle_soa &parts, double softening = 0.0);
+
+// Force routine for the integrators, sums over all particles for each
+// active one
+force_fn direct_force(double softening = 0.0);
+
+#endif
@@ -0,0 +1,497 @@
+/*-------------distributed.cpp------------------------------------------------//
+*
+* Purpose: Distributed memory Barnes Hut, ORB domains and locally essential
+*          trees exchanged between MPI ranks
+*
+*   Notes: Cuts are found by bisection on the particle counts, all groups
+*          of one ORB level share each MPI_Allreduce
+*
+*-----------------------------------------------------------------------------*/
+
+#include <limits>
+#include "distributed.h"
+
+/*----------------------------------------------------------------------------//
+* SUBROUTINES
+*-----------------------------------------------------------------------------*/
+
+// Bisection steps per cut, enough to resolve 1e-12 of the box
+const int ORB_ITERATIONS = 40;
+
+// Ranks still to be split, with the slot of the split that points at them
+struct orb_group {
+    vec lo, hi;
+    int first, n_ranks;
+    int parent;
+    bool high_side;
+};
+
+static double& component(vec &v, int axis){
+    return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+}
+
+static double component(const vec &v, int axis){
+    return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+}
+
+static bool in_box(vec pos, vec lo, vec hi){
+    return pos.x >= lo.x && pos.x < hi.x && pos.y >= lo.y && pos.y < hi.y
+           && pos.z >= lo.z && pos.z < hi.z;
+}
+
+// Bounding box of the particles, lo > hi if there are none
+static void bounding_box(const std::vector<particle> &p_vec, vec &lo,
+                         vec &hi){
+    const double inf = std::numeric_limits<double>::infinity();
+    lo = vec(inf, inf, inf);
+    hi = vec(-inf, -inf, -inf);
+    for (auto &part : p_vec){
+        lo = vec(std::min(lo.x, part.p.x), std::min(lo.y, part.p.y),
+                 std::min(lo.z, part.p.z));
+        hi = vec(std::max(hi.x, part.p.x), std::max(hi.y, part.p.y),
+                 std::max(hi.z, part.p.z));
+    }
+}
+
+// Particle of an essential tree, sent as one element so the counts of the
+// exchange are particles rather than doubles
+struct let_particle {
+    double x, y, z, mass;
+};
+
+// MPI_Alltoallv for any trivially copyable type, counts are in elements.
+// MPI counts and offsets are int, so big exchanges go in rounds of at most
+// INT_MAX / n_ranks elements per rank, through staging buffers whose
+// offsets fit in an int.
+template <typename T>
+static void all_to_all(MPI_Comm comm, const std::vector<T> &send,
+                       const std::vector<size_t> &send_counts,
+                       std::vector<T> &recv,
+                       std::vector<size_t> &recv_counts){
+    int n_ranks;
+    MPI_Comm_size(comm, &n_ranks);
+
+    MPI_Datatype type;
+    MPI_Type_contiguous(sizeof(T), MPI_BYTE, &type);
+    MPI_Type_commit(&type);
+
+    std::vector<unsigned long long> counts(send_counts.begin(),
+                                           send_counts.end());
+    std::vector<unsigned long long> recv_ull(n_ranks);
+    MPI_Alltoall(counts.data(), 1, MPI_UNSIGNED_LONG_LONG, recv_ull.data(), 1,
+                 MPI_UNSIGNED_LONG_LONG, comm);
+    recv_counts.assign(recv_ull.begin(), recv_ull.end());
+
+    std::vector<size_t> send_offsets(n_ranks, 0), recv_offsets(n_ranks, 0);
+    unsigned long long largest = 0;
+    for (int r = 0; r < n_ranks; ++r){
+        if (r > 0){
+            send_offsets[r] = send_offsets[r - 1] + send_counts[r - 1];
+            recv_offsets[r] = recv_offsets[r - 1] + recv_counts[r - 1];
+        }
+        largest = std::max(largest, (unsigned long long)
+                           std::max(send_counts[r], recv_counts[r]));
+    }
+    recv.resize(recv_offsets[n_ranks - 1] + recv_counts[n_ranks - 1]);
+
+    // Every rank has to take part in every round
+    MPI_Allreduce(MPI_IN_PLACE, &largest, 1, MPI_UNSIGNED_LONG_LONG, MPI_MAX,
+                  comm);
+    size_t chunk = std::max(std::numeric_limits<int>::max() / n_ranks, 1);
+    size_t rounds = (largest + chunk - 1) / chunk;
+
+    std::vector<T> send_stage, recv_stage;
+    std::vector<int> round_send(n_ranks), round_recv(n_ranks);
+    std::vector<int> stage_send_offsets(n_ranks), stage_recv_offsets(n_ranks);
+    for (size_t round = 0; round < rounds; ++round){
+        size_t done = round * chunk;
+        int send_total = 0, recv_total = 0;
+        for (int r = 0; r < n_ranks; ++r){
+            round_send[r] = send_counts[r] > done
+                            ? std::min(send_counts[r] - done, chunk) : 0;
+            round_recv[r] = recv_counts[r] > done
+                            ? std::min(recv_counts[r] - done, chunk) : 0;
+            stage_send_offsets[r] = send_total;
+            stage_recv_offsets[r] = recv_total;
+            send_total += round_send[r];
+            recv_total += round_recv[r];
+        }
+
+        send_stage.resize(send_total);
+        for (int r = 0; r < n_ranks; ++r){
+            std::copy(send.begin() + send_offsets[r] + done,
+                      send.begin() + send_offsets[r] + done + round_send[r],
+                      send_stage.begin() + stage_send_offsets[r]);
+        }
+
+        recv_stage.resize(recv_total);
+        MPI_Alltoallv(send_stage.data(), round_send.data(),
+                      stage_send_offsets.data(), type, recv_stage.data(),
+                      round_recv.data(), stage_recv_offsets.data(), type,
+                      comm);
+
+        for (int r = 0; r < n_ranks; ++r){
+            std::copy(recv_stage.begin() + stage_recv_offsets[r],
+                      recv_stage.begin() + stage_recv_offsets[r]
+                      + round_recv[r],
+                      recv.begin() + recv_offsets[r] + done);
+        }
+    }
+    MPI_Type_free(&type);
+}
+
+// Rank owning a position, positions outside go to the nearest box
+int orb_domain::owner(vec pos) const{
+    if (splits.empty()){
+        return 0;
+    }
+
+    int curr = 0;
+    while (true){
+        const orb_split &split = splits[curr];
+        int child = component(pos, split.axis) < split.cut ? split.low
+                                                            : split.high;
+        if (child < 0){
+            return -child - 1;
+        }
+        curr = child;
+    }
+}
+
+// Splits space between the ranks of comm so each gets about as many
+// particles. Groups of ranks are halved level by level along the longest
+// side of their box, uneven groups get an uneven share of particles.
+void orb_decompose(MPI_Comm comm, const std::vector<particle> &p_vec,
+                   orb_domain &domain){
+    int n_ranks;
+    MPI_Comm_size(comm, &n_ranks);
+
+    // Bounding box of all particles, the max is found as min of -hi
+    vec lo, hi;
+    bounding_box(p_vec, lo, hi);
+    double local[6] = {lo.x, lo.y, lo.z, -hi.x, -hi.y, -hi.z};
+    double global[6];
+    MPI_Allreduce(local, global, 6, MPI_DOUBLE, MPI_MIN, comm);
+    lo = vec(global[0], global[1], global[2]);
+    hi = vec(-global[3], -global[4], -global[5]);
+    if (lo.x > hi.x){
+        lo = vec(-0.5, -0.5, -0.5);
+        hi = vec(0.5, 0.5, 0.5);
+    }
+
+    // Boxes are [lo, hi), so the largest coordinate is nudged inside
+    const double inf = std::numeric_limits<double>::infinity();
+    hi = vec(std::nextafter(hi.x, inf), std::nextafter(hi.y, inf),
+             std::nextafter(hi.z, inf));
+
+    domain.splits.clear();
+    domain.lo.assign(n_ranks, lo);
+    domain.hi.assign(n_ranks, hi);
+
+    auto link = [&domain](const orb_group &group, int child){
+        if (group.parent < 0){
+            return;
+        }
+        if (group.high_side){
+            domain.splits[group.parent].high = child;
+        }
+        else{
+            domain.splits[group.parent].low = child;
+        }
+    };
+
+    std::vector<orb_group> groups(1, orb_group{lo, hi, 0, n_ranks, -1,
+                                               false});
+    std::vector<int> group_of(p_vec.size());
+
+    while (!groups.empty()){
+        std::vector<orb_group> todo;
+        for (auto &group : groups){
+            if (group.n_ranks == 1){
+                domain.lo[group.first] = group.lo;
+                domain.hi[group.first] = group.hi;
+                link(group, -(group.first + 1));
+            }
+            else{
+                todo.push_back(group);
+            }
+        }
+        groups.clear();
+        if (todo.empty()){
+            break;
+        }
+
+        size_t n_groups = todo.size();
+        std::vector<int> axis(n_groups);
+        std::vector<double> low(n_groups), high(n_groups), cut(n_groups);
+        std::vector<long long> counts(n_groups), total(n_groups);
+
+        // Groups are disjoint, so each particle is in at most one
+        std::fill(counts.begin(), counts.end(), 0);
+        for (size_t i = 0; i < p_vec.size(); ++i){
+            group_of[i] = -1;
+            for (size_t g = 0; g < n_groups; ++g){
+                if (in_box(p_vec[i].p, todo[g].lo, todo[g].hi)){
+                    group_of[i] = g;
+                    ++counts[g];
+                    break;
+                }
+            }
+        }
+        MPI_Allreduce(counts.data(), total.data(), n_groups, MPI_LONG_LONG,
+                      MPI_SUM, comm);
+
+        for (size_t g = 0; g < n_groups; ++g){
+            vec size = todo[g].hi - todo[g].lo;
+            axis[g] = size.x >= size.y && size.x >= size.z ? 0
+                      : size.y >= size.z ? 1 : 2;
+            low[g] = component(todo[g].lo, axis[g]);
+            high[g] = component(todo[g].hi, axis[g]);
+        }
+
+        for (int iter = 0; iter < ORB_ITERATIONS; ++iter){
+            for (size_t g = 0; g < n_groups; ++g){
+                cut[g] = 0.5 * (low[g] + high[g]);
+                counts[g] = 0;
+            }
+            for (size_t i = 0; i < p_vec.size(); ++i){
+                int g = group_of[i];
+                if (g >= 0 && component(p_vec[i].p, axis[g]) < cut[g]){
+                    ++counts[g];
+                }
+            }
+
+            std::vector<long long> below(n_groups);
+            MPI_Allreduce(counts.data(), below.data(), n_groups,
+                          MPI_LONG_LONG, MPI_SUM, comm);
+
+            for (size_t g = 0; g < n_groups; ++g){
+                int n_low = todo[g].n_ranks / 2;
+                if (below[g] * todo[g].n_ranks < total[g] * n_low){
+                    low[g] = cut[g];
+                }
+                else{
+                    high[g] = cut[g];
+                }
+            }
+        }
+
+        for (size_t g = 0; g < n_groups; ++g){
+            const orb_group &group = todo[g];
+            int slot = domain.splits.size();
+            domain.splits.push_back(orb_split{axis[g], high[g], 0, 0});
+            link(group, slot);
+
+            int n_low = group.n_ranks / 2;
+            orb_group lower{group.lo, group.hi, group.first, n_low, slot,
+                            false};
+            orb_group upper{group.lo, group.hi, group.first + n_low,
+                            group.n_ranks - n_low, slot, true};
+            component(lower.hi, axis[g]) = high[g];
+            component(upper.lo, axis[g]) = high[g];
+            groups.push_back(lower);
+            groups.push_back(upper);
+        }
+    }
+}
+
+// Sends every particle to the rank owning it
+void exchange_particles(MPI_Comm comm, const orb_domain &domain,
+                        std::vector<particle> &p_vec){
+    int n_ranks;
+    MPI_Comm_size(comm, &n_ranks);
+
+    std::vector<int> owner(p_vec.size());
+    std::vector<size_t> send_counts(n_ranks, 0);
+    for (size_t i = 0; i < p_vec.size(); ++i){
+        owner[i] = domain.owner(p_vec[i].p);
+        ++send_counts[owner[i]];
+    }
+
+    // Counting sort by owner, keeping the order within each rank
+    std::vector<size_t> offset(n_ranks, 0);
+    for (int r = 1; r < n_ranks; ++r){
+        offset[r] = offset[r - 1] + send_counts[r - 1];
+    }
+    std::vector<particle> send(p_vec.size());
+    for (size_t i = 0; i < p_vec.size(); ++i){
+        send[offset[owner[i]]++] = p_vec[i];
+    }
+
+    std::vector<size_t> recv_counts;
+    all_to_all(comm, send, send_counts, p_vec, recv_counts);
+}
+
+// Copies node curr and the part of its subtree needed by [lo, hi] into
+// let, returns its index there. A node that every position in the box
+// would accept is cut off, so the walk never needs what is below it.
+static int copy_essential(const linear_octree &tree, int curr, vec lo,
+                          vec hi, linear_octree &let){
+    const lnode &curr_node = tree.nodes[curr];
+
+    int slot = let.nodes.size();
+    let.nodes.push_back(curr_node);
+    let.nodes[slot].children.fill(-1);
+    let.nodes[slot].begin = let.x.size();
+    let.nodes[slot].end = let.x.size();
+
+    // Distance from the center of mass to the closest point of the box
+    vec com = curr_node.com.p;
+    vec d(std::max(std::max(lo.x - com.x, com.x - hi.x), 0.0),
+          std::max(std::max(lo.y - com.y, com.y - hi.y), 0.0),
+          std::max(std::max(lo.z - com.z, com.z - hi.z), 0.0));
+    double r = length(d);
+
+    // The walk always opens a node holding the position, so the node must
+    // not touch the box either
+    double half_box = curr_node.box_length * 0.5;
+    bool overlaps = curr_node.p.x + half_box >= lo.x
+                    && curr_node.p.x - half_box <= hi.x
+                    && curr_node.p.y + half_box >= lo.y
+                    && curr_node.p.y - half_box <= hi.y
+                    && curr_node.p.z + half_box >= lo.z
+                    && curr_node.p.z - half_box <= hi.z;
+
+    if (!overlaps && r > 0 && curr_node.box_length <= tree.theta * r){
+        return slot;
+    }
+
+    if (is_leaf(curr_node)){
+        for (size_t j = curr_node.begin; j < curr_node.end; ++j){
+            let.x.push_back(tree.x[j]);
+            let.y.push_back(tree.y[j]);
+            let.z.push_back(tree.z[j]);
+            let.mass.push_back(tree.mass[j]);
+        }
+        let.nodes[slot].end = let.x.size();
+        return slot;
+    }
+
+    for (int n = 0; n < 8; ++n){
+        if (curr_node.children[n] >= 0){
+            int child = copy_essential(tree, curr_node.children[n], lo, hi,
+                                       let);
+            let.nodes[child].parent = slot;
+            let.nodes[slot].children[n] = child;
+        }
+    }
+    return slot;
+}
+
+// Copies the part of tree needed by any particle in [lo, hi] into let
+void essential_tree(const linear_octree &tree, vec lo, vec hi,
+                    linear_octree &let){
+    let.p = tree.p;
+    let.box_length = tree.box_length;
+    let.theta = tree.theta;
+    let.softening = tree.softening;
+    let.nodes.clear();
+    let.x.clear();
+    let.y.clear();
+    let.z.clear();
+    let.mass.clear();
+
+    if (!tree.nodes.empty() && tree.nodes[0].end > tree.nodes[0].begin){
+        copy_essential(tree, 0, lo, hi, let);
+        let.nodes[0].parent = -1;
+    }
+}
+
+// Finds acc for all local particles, from the local tree and the essential
+// trees of all other ranks
+void distributed_force(MPI_Comm comm, linear_octree &tree,
+                       std::vector<particle> &p_vec, size_t box_threshold){
+    int n_ranks, rank;
+    MPI_Comm_size(comm, &n_ranks);
+    MPI_Comm_rank(comm, &rank);
+
+    // Local tree over the bounding cube of the local particles
+    vec lo, hi;
+    bounding_box(p_vec, lo, hi);
+    fit_linear_octree(tree, p_vec);
+    make_linear_octree(tree, p_vec, box_threshold);
+
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < p_vec.size(); ++i){
+        p_vec[i].acc = vec();
+    }
+    if (!p_vec.empty()){
+        parallel_force(tree, p_vec);
+    }
+
+    // Everyone's actual particle box, which may have drifted out of its
+    // ORB box since the last decomposition
+    double box[6] = {lo.x, lo.y, lo.z, hi.x, hi.y, hi.z};
+    std::vector<double> boxes(6 * n_ranks);
+    MPI_Allgather(box, 6, MPI_DOUBLE, boxes.data(), 6, MPI_DOUBLE, comm);
+
+    // Essential trees for every other rank
+    std::vector<lnode> send_nodes;
+    std::vector<let_particle> send_parts;
+    std::vector<size_t> node_counts(n_ranks, 0), part_counts(n_ranks, 0);
+    linear_octree let;
+    let.theta = tree.theta;
+    let.softening = tree.softening;
+    for (int r = 0; r < n_ranks; ++r){
+        vec r_lo(boxes[6 * r], boxes[6 * r + 1], boxes[6 * r + 2]);
+        vec r_hi(boxes[6 * r + 3], boxes[6 * r + 4], boxes[6 * r + 5]);
+        if (r == rank || r_lo.x > r_hi.x || p_vec.empty()){
+            continue;
+        }
+
+        essential_tree(tree, r_lo, r_hi, let);
+        send_nodes.insert(send_nodes.end(), let.nodes.begin(),
+                          let.nodes.end());
+        for (size_t j = 0; j < let.x.size(); ++j){
+            send_parts.push_back(let_particle{let.x[j], let.y[j], let.z[j],
+                                              let.mass[j]});
+        }
+        node_counts[r] = let.nodes.size();
+        part_counts[r] = let.x.size();
+    }
+
+    std::vector<lnode> recv_nodes;
+    std::vector<let_particle> recv_parts;
+    std::vector<size_t> recv_node_counts, recv_part_counts;
+    all_to_all(comm, send_nodes, node_counts, recv_nodes, recv_node_counts);
+    all_to_all(comm, send_parts, part_counts, recv_parts, recv_part_counts);
+
+    // Unpacking every received tree and searching it for each particle
+    size_t node_offset = 0, part_offset = 0;
+    for (int r = 0; r < n_ranks; ++r){
+        if (recv_node_counts[r] == 0){
+            continue;
+        }
+
+        let.nodes.assign(recv_nodes.begin() + node_offset,
+                         recv_nodes.begin() + node_offset
+                         + recv_node_counts[r]);
+        size_t n_parts = recv_part_counts[r];
+        let.x.resize(n_parts);
+        let.y.resize(n_parts);
+        let.z.resize(n_parts);
+        let.mass.resize(n_parts);
+        for (size_t j = 0; j < n_parts; ++j){
+            const let_particle &packed = recv_parts[part_offset + j];
+            let.x[j] = packed.x;
+            let.y[j] = packed.y;
+            let.z[j] = packed.z;
+            let.mass[j] = packed.mass;
+        }
+        node_offset += recv_node_counts[r];
+        part_offset += recv_part_counts[r];
+
+        #pragma omp parallel for schedule(dynamic, 64)
+        for (size_t i = 0; i < p_vec.size(); ++i){
+            RKsearch(let, 0, &p_vec[i]);
+        }
+    }
+}
+
+// Force routine for the integrators, every local particle every time
+force_fn mpi_force(MPI_Comm comm, linear_octree &tree, size_t box_threshold){
+    return [comm, &tree, box_threshold](std::vector<particle> &p_vec,
+                                        const std::vector<size_t> &){
+        distributed_force(comm, tree, p_vec, box_threshold);
+    };
+}
@@ -0,0 +1,71 @@
+/*-------------distributed.h--------------------------------------------------//
+*
+* Purpose: Header file for distributed.cpp, Barnes Hut over MPI ranks with
+*          an orthogonal recursive bisection (ORB) of space and locally
+*          essential trees (LETs)
+*
+*   Notes: Every rank owns the particles in its ORB box and builds a linear
+*          octree of them. Before a force pass each rank sends every other
+*          rank the part of its tree that rank can need: nodes accepted for
+*          all of the other rank's particles are cut off as multipoles, the
+*          rest is opened down to the leaf buckets. The received trees are
+*          searched with the usual RKsearch, nothing is fetched on demand.
+*
+*          Only built by "make mpi", run with e.g. mpirun -np 4
+*
+*-----------------------------------------------------------------------------*/
+
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include <mpi.h>
+#include "integrator.h"
+#include "linear_octree.h"
+
+/*----------------------------------------------------------------------------//
+* STRUCTS
+*-----------------------------------------------------------------------------*/
+
+// Cut of one ORB level, particles with pos[axis] < cut go to low
+// Children are indices into orb_domain::splits, or -(rank + 1) for a box
+struct orb_split {
+    int axis;
+    double cut;
+    int low, high;
+};
+
+struct orb_domain {
+    // Cuts, the root is splits[0] (empty for a single rank)
+    std::vector<orb_split> splits;
+
+    // Box [lo, hi) of every rank
+    std::vector<vec> lo, hi;
+
+    // Rank owning a position, positions outside go to the nearest box
+    int owner(vec pos) const;
+};
+
+// Splits space between the ranks of comm so each gets about as many
+// particles, every rank gets the same domain
+void orb_decompose(MPI_Comm comm, const std::vector<particle> &p_vec,
+                   orb_domain &domain);
+
+// Sends every particle to the rank owning it
+void exchange_particles(MPI_Comm comm, const orb_domain &domain,
+                        std::vector<particle> &p_vec);
+
+// Copies the part of tree needed by any particle in [lo, hi] into let
+void essential_tree(const linear_octree &tree, vec lo, vec hi,
+                    linear_octree &let);
+
+// Finds acc for all local particles, from the local tree and the essential
+// trees of all other ranks. Collective, every rank must call it.
+void distributed_force(MPI_Comm comm, linear_octree &tree,
+                       std::vector<particle> &p_vec, size_t box_threshold);
+
+// Force routine for the integrators. Always finds every local particle, so
+// it suits leapfrog and rk4, but not block steps (ranks would disagree on
+// the number of substeps).
+force_fn mpi_force(MPI_Comm comm, linear_octree &tree, size_t box_threshold);
+
+#endif
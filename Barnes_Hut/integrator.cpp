@@ -0,0 +1,287 @@
+/*-------------integrator.cpp-------------------------------------------------//
+*
+* Purpose: Time integrators for the Barnes Hut simulation, each stage finds
+*          a new force instead of reusing the acc from the start of the step
+*
+*   Notes: block_step counts time in ticks of dt / 2^max_bin, so a particle
+*          in bin b is active every 2^(max_bin - b) ticks
+*
+*-----------------------------------------------------------------------------*/
+
+#include <cmath>
+#include "integrator.h"
+
+/*----------------------------------------------------------------------------//
+* SUBROUTINES
+*-----------------------------------------------------------------------------*/
+
+// Calls the force routine and keeps count of the work done
+static void find_force(integrator &integ, std::vector<particle> &p_vec,
+                       const std::vector<size_t> &active,
+                       const force_fn &force){
+    force(p_vec, active);
+    integ.force_evals += active.size();
+}
+
+static std::vector<size_t> all_particles(const std::vector<particle> &p_vec){
+    std::vector<size_t> active(p_vec.size());
+    for (size_t i = 0; i < active.size(); ++i){
+        active[i] = i;
+    }
+    return active;
+}
+
+// Finds acc for all particles and, for block timesteps, their first bins
+void init_integrator(integrator &integ, std::vector<particle> &p_vec,
+                     const force_fn &force){
+    integ.max_bin = std::min(std::max(integ.max_bin, 0), MAX_TIME_BIN);
+    find_force(integ, p_vec, all_particles(p_vec), force);
+
+    if (integ.type == integrator_type::block){
+        integ.bins.resize(p_vec.size());
+        for (size_t i = 0; i < p_vec.size(); ++i){
+            integ.bins[i] = time_bin(integ, p_vec[i]);
+        }
+    }
+}
+
+// Advances all particles by integ.dt with the chosen integrator
+void integrate_step(integrator &integ, std::vector<particle> &p_vec,
+                    const force_fn &force){
+    switch (integ.type){
+    case integrator_type::leapfrog:
+        leapfrog_step(integ, p_vec, force);
+        break;
+    case integrator_type::rk4:
+        rk4_step(integ, p_vec, force);
+        break;
+    case integrator_type::block:
+        block_step(integ, p_vec, force);
+        break;
+    }
+
+    integ.time += integ.dt;
+    ++integ.steps;
+}
+
+// Kick-drift-kick leapfrog, the closing kick uses the force at the new
+// positions, which is also the opening kick's force of the next step
+void leapfrog_step(integrator &integ, std::vector<particle> &p_vec,
+                   const force_fn &force){
+    double dt = integ.dt;
+
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < p_vec.size(); ++i){
+        p_vec[i].vel += 0.5 * dt * p_vec[i].acc;
+        p_vec[i].p += dt * p_vec[i].vel;
+    }
+
+    find_force(integ, p_vec, all_particles(p_vec), force);
+
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < p_vec.size(); ++i){
+        p_vec[i].vel += 0.5 * dt * p_vec[i].acc;
+    }
+}
+
+// Runge-Kutta 4, with the force found again at every stage. The last pass
+// (at the new positions) doubles as the first stage of the next step.
+void rk4_step(integrator &integ, std::vector<particle> &p_vec,
+              const force_fn &force){
+    double dt = integ.dt;
+    size_t n = p_vec.size();
+    std::vector<size_t> active = all_particles(p_vec);
+
+    // Start of the step and the running sums of the stages
+    std::vector<vec> pos0(n), vel0(n), dpos(n), dvel(n);
+
+    // Velocity of the stage being evaluated
+    std::vector<vec> vel_k(n);
+
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < n; ++i){
+        pos0[i] = p_vec[i].p;
+        vel0[i] = p_vec[i].vel;
+        vel_k[i] = p_vec[i].vel;
+        dpos[i] = p_vec[i].vel;
+        dvel[i] = p_vec[i].acc;
+    }
+
+    // Stages 2 and 3 go half a step from the start, stage 4 a full step
+    const double offset[3] = {0.5, 0.5, 1.0};
+    const double weight[3] = {2.0, 2.0, 1.0};
+
+    for (int s = 0; s < 3; ++s){
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < n; ++i){
+            vec acc_k = p_vec[i].acc;
+            p_vec[i].p = pos0[i] + offset[s] * dt * vel_k[i];
+            vel_k[i] = vel0[i] + offset[s] * dt * acc_k;
+            dpos[i] += weight[s] * vel_k[i];
+        }
+
+        find_force(integ, p_vec, active, force);
+
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < n; ++i){
+            dvel[i] += weight[s] * p_vec[i].acc;
+        }
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < n; ++i){
+        p_vec[i].p = pos0[i] + (dt / 6) * dpos[i];
+        p_vec[i].vel = vel0[i] + (dt / 6) * dvel[i];
+    }
+
+    find_force(integ, p_vec, active, force);
+}
+
+// Function to find the bin a particle asks for with its current acc
+int time_bin(const integrator &integ, const particle &part){
+    double acc = length(part.acc);
+    if (acc == 0.0){
+        return 0;
+    }
+
+    double wanted = sqrt(integ.eta * integ.length / acc);
+    int bin = 0;
+    double step = integ.dt;
+    while (step > wanted && bin < integ.max_bin){
+        step *= 0.5;
+        ++bin;
+    }
+    return bin;
+}
+
+// Block timestep leapfrog. Every particle is kicked over its own step while
+// all of them drift together, from one active tick to the next. Particles
+// move to a deeper bin at the end of any step, but to a shallower one only
+// when the current tick lines up with the longer step.
+void block_step(integrator &integ, std::vector<particle> &p_vec,
+                const force_fn &force){
+    int max_bin = integ.max_bin;
+    size_t n = p_vec.size();
+    size_t total = (size_t)1 << max_bin;
+    double tick = integ.dt / total;
+
+    auto ticks = [max_bin](int bin){
+        return (size_t)1 << (max_bin - bin);
+    };
+
+    // Everyone is in sync at the start, so everyone opens a step
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < n; ++i){
+        p_vec[i].vel += 0.5 * ticks(integ.bins[i]) * tick * p_vec[i].acc;
+    }
+
+    std::vector<size_t> active;
+    size_t t = 0;
+    while (t < total){
+        int deepest = 0;
+        for (size_t i = 0; i < n; ++i){
+            deepest = std::max(deepest, integ.bins[i]);
+        }
+
+        size_t next = t + ticks(deepest);
+        double drift = (next - t) * tick;
+
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < n; ++i){
+            p_vec[i].p += drift * p_vec[i].vel;
+        }
+        t = next;
+
+        active.clear();
+        for (size_t i = 0; i < n; ++i){
+            if (t % ticks(integ.bins[i]) == 0){
+                active.push_back(i);
+            }
+        }
+
+        find_force(integ, p_vec, active, force);
+
+        #pragma omp parallel for schedule(static)
+        for (size_t a = 0; a < active.size(); ++a){
+            size_t i = active[a];
+            particle &part = p_vec[i];
+            int &bin = integ.bins[i];
+
+            // Closing kick of the step that just ended
+            part.vel += 0.5 * ticks(bin) * tick * part.acc;
+
+            int wanted = time_bin(integ, part);
+            if (wanted > bin){
+                bin = wanted;
+            }
+            while (bin > wanted && t % ticks(bin - 1) == 0){
+                --bin;
+            }
+
+            // Opening kick of the next one, done by the next call at the end
+            if (t < total){
+                part.vel += 0.5 * ticks(bin) * tick * part.acc;
+            }
+        }
+    }
+}
+
+// Force from the pointer octree, refitted (or rebuilt) on every call
+force_fn octree_force(octree &tree, size_t box_threshold,
+                      std::vector<double> *pot){
+    return [&tree, box_threshold, pot](std::vector<particle> &p_vec,
+                                       const std::vector<size_t> &active){
+        node *root;
+        if (tree.needs_rebuild || tree.index.size() != p_vec.size()){
+            root = make_octree(tree, p_vec);
+            divide_octree(tree, root, box_threshold);
+        }
+        else{
+            root = update_octree(tree, p_vec, box_threshold);
+        }
+
+        // The potential comes out of the same walk, at almost no cost
+        if (pot){
+            pot->resize(p_vec.size());
+        }
+
+        #pragma omp parallel for schedule(dynamic, 64)
+        for (size_t a = 0; a < active.size(); ++a){
+            particle *part = &p_vec[active[a]];
+            part->acc = vec();
+            if (pot){
+                (*pot)[active[a]] = 0.0;
+                RKsearch(root, part, &(*pot)[active[a]]);
+            }
+            else{
+                RKsearch(root, part);
+            }
+        }
+    };
+}
+
+// Force from the linear octree, rebuilt over the bounding cube of the
+// particles on every call. A pass for all particles goes leaf by leaf, a
+// partial one walks the tree per particle.
+force_fn linear_force(linear_octree &tree, size_t box_threshold){
+    return [&tree, box_threshold](std::vector<particle> &p_vec,
+                                  const std::vector<size_t> &active){
+        fit_linear_octree(tree, p_vec);
+        make_linear_octree(tree, p_vec, box_threshold);
+
+        if (active.size() == p_vec.size()){
+            #pragma omp parallel for schedule(static)
+            for (size_t i = 0; i < p_vec.size(); ++i){
+                p_vec[i].acc = vec();
+            }
+            parallel_force(tree, p_vec);
+            return;
+        }
+
+        #pragma omp parallel for schedule(dynamic, 64)
+        for (size_t a = 0; a < active.size(); ++a){
+            particle &part = p_vec[active[a]];
+            part.acc = tree_walk(tree, active[a]);
+        }
+    };
+}
@@ -0,0 +1,99 @@
+/*-------------integrator.h---------------------------------------------------//
+*
+* Purpose: Header file for integrator.cpp, time integrators that go back to
+*          the force routine at every stage instead of reusing one acc
+*
+*   Notes: The force routine only has to fill in acc for the particles it is
+*          asked for, so the integrators work the same with either tree.
+*          Every integrator expects acc to be valid at the start of a step
+*          and leaves it valid at the end, init_integrator does the first one.
+*
+*-----------------------------------------------------------------------------*/
+
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include <functional>
+#include "barnes_hut.h"
+#include "linear_octree.h"
+
+/*----------------------------------------------------------------------------//
+* STRUCTS
+*-----------------------------------------------------------------------------*/
+
+// Sets acc of every particle p_vec[active[i]], with all of p_vec as sources
+using force_fn = std::function<void(std::vector<particle> &p_vec,
+                                    const std::vector<size_t> &active)>;
+
+enum class integrator_type {
+    // Kick-drift-kick leapfrog, symplectic and one force pass per step
+    leapfrog,
+
+    // Classic Runge-Kutta 4, four force passes per step
+    rk4,
+
+    // Leapfrog with power-of-two timesteps per particle, only the particles
+    // at the end of their step get a new force
+    block
+};
+
+// Deepest time bin allowed, the smallest step is dt / 2^MAX_TIME_BIN
+const int MAX_TIME_BIN = 30;
+
+struct integrator {
+    integrator_type type;
+
+    // Step of one integrate_step call, the largest (bin 0) step for block
+    double dt;
+
+    // Block timestep criterion dt_i = sqrt(eta * length / |acc_i|). length
+    // should be about the smallest scale resolved (the softening length).
+    double eta, length;
+
+    // Deepest bin used by block, at most MAX_TIME_BIN
+    int max_bin;
+
+    // Time bin of every particle, a particle in bin b steps dt / 2^b
+    std::vector<int> bins;
+
+    double time;
+    size_t steps;
+
+    // Single particle force evaluations done so far, the cost of a run
+    size_t force_evals;
+
+    integrator(integrator_type kind, double step)
+        : type(kind), dt(step), eta(0.02), length(SOFTENING), max_bin(12),
+          time(0.0), steps(0), force_evals(0) {}
+};
+
+// Finds acc for all particles and, for block timesteps, their first bins
+void init_integrator(integrator &integ, std::vector<particle> &p_vec,
+                     const force_fn &force);
+
+// Advances all particles by integ.dt with the chosen integrator
+void integrate_step(integrator &integ, std::vector<particle> &p_vec,
+                    const force_fn &force);
+
+void leapfrog_step(integrator &integ, std::vector<particle> &p_vec,
+                   const force_fn &force);
+
+void rk4_step(integrator &integ, std::vector<particle> &p_vec,
+              const force_fn &force);
+
+void block_step(integrator &integ, std::vector<particle> &p_vec,
+                const force_fn &force);
+
+// Function to find the bin a particle asks for with its current acc
+int time_bin(const integrator &integ, const particle &part);
+
+// Force routines for the two trees. The tree is kept by reference and must
+// outlive the returned function, p_vec must not be resized in between.
+// octree_force refits between calls, setting tree.needs_rebuild makes the
+// next call rebuild from scratch. If pot is given, the potential of every
+// particle found is stored there (indexed like p_vec) by the same walk.
+force_fn octree_force(octree &tree, size_t box_threshold,
+                      std::vector<double> *pot = nullptr);
+force_fn linear_force(linear_octree &tree, size_t box_threshold);
+
+#endif
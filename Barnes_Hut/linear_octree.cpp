@@ -0,0 +1,739 @@
+/*-------------linear_octree.cpp----------------------------------------------//
+*
+* Purpose: Build the Barnes Hut octree without recursion through pointers.
+*          Particles are sorted once by Morton key, after which the children
+*          of every node are just contiguous sub-ranges of the sorted keys.
+*
+*   Notes: Octant bits in the key are z y x (from high to low), which is the
+*          same numbering make_octchild uses: 4 * z + 2 * y + x
+*
+*-----------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include "linear_octree.h"
+
+/*----------------------------------------------------------------------------//
+* SUBROUTINES
+*-----------------------------------------------------------------------------*/
+
+// Spreads the lower 21 bits of a number so there are two 0's between each bit
+static uint64_t split_by_3(uint64_t a){
+    a &= 0x1fffff;
+    a = (a | a << 32) & 0x1f00000000ffff;
+    a = (a | a << 16) & 0x1f0000ff0000ff;
+    a = (a | a << 8)  & 0x100f00f00f00f00f;
+    a = (a | a << 4)  & 0x10c30c30c30c30c3;
+    a = (a | a << 2)  & 0x1249249249249249;
+    return a;
+}
+
+// LSD radix sort of (key, index) pairs, 6 passes of 11 bits cover 63 bits
+static void radix_sort(std::vector<std::pair<uint64_t, size_t>> &pairs){
+    const int digit_bits = 11;
+    const int passes = 6;
+    const size_t buckets = 1 << digit_bits;
+
+    // Histogram for every pass at once, so the input is only read once here
+    std::vector<size_t> count(passes * buckets, 0);
+    for (auto &pair : pairs){
+        for (int pass = 0; pass < passes; ++pass){
+            ++count[pass * buckets
+                    + ((pair.first >> (pass * digit_bits)) & (buckets - 1))];
+        }
+    }
+
+    std::vector<std::pair<uint64_t, size_t>> buffer(pairs.size());
+    for (int pass = 0; pass < passes; ++pass){
+        size_t *offset = &count[pass * buckets];
+
+        // A pass where every key falls in the same bucket changes nothing
+        if (offset[(pairs[0].first >> (pass * digit_bits)) & (buckets - 1)]
+            == pairs.size()){
+            continue;
+        }
+
+        size_t sum = 0;
+        for (size_t i = 0; i < buckets; ++i){
+            size_t tmp = offset[i];
+            offset[i] = sum;
+            sum += tmp;
+        }
+
+        for (auto &pair : pairs){
+            buffer[offset[(pair.first >> (pass * digit_bits))
+                          & (buckets - 1)]++] = pair;
+        }
+        pairs.swap(buffer);
+    }
+}
+
+// Function to find the 63-bit Morton key of a position within a box
+uint64_t morton_key(vec pos, vec llv, double box_length){
+    const double cells = (double)(1 << MORTON_BITS);
+    const double scale = cells / box_length;
+
+    // Particles outside of the box are clamped onto its surface
+    auto quantize = [&](double x){
+        double cell = x * scale;
+        if (cell < 0.0){
+            return (uint64_t)0;
+        }
+        if (cell >= cells){
+            return (uint64_t)((1 << MORTON_BITS) - 1);
+        }
+        return (uint64_t)cell;
+    };
+
+    return split_by_3(quantize(pos.x - llv.x))
+           | split_by_3(quantize(pos.y - llv.y)) << 1
+           | split_by_3(quantize(pos.z - llv.z)) << 2;
+}
+
+// Sets the root box to the bounding cube of the particles, if any
+// The cube is made a hair larger so no particle lies on its far faces
+template <typename P>
+void fit_linear_octree(linear_octree &tree, const P &parts){
+    if (parts.size() == 0){
+        return;
+    }
+
+    vec lo = particle_pos(parts, 0), hi = lo;
+    for (size_t i = 1; i < parts.size(); ++i){
+        vec pos = particle_pos(parts, i);
+        lo = vec(std::min(lo.x, pos.x), std::min(lo.y, pos.y),
+                 std::min(lo.z, pos.z));
+        hi = vec(std::max(hi.x, pos.x), std::max(hi.y, pos.y),
+                 std::max(hi.z, pos.z));
+    }
+
+    vec size = hi - lo;
+    double extent = std::max(std::max(size.x, size.y), size.z);
+    tree.p = 0.5 * (lo + hi);
+    tree.box_length = extent > 0 ? extent * (1 + 1e-9) : 1.0;
+}
+
+// Builds the whole linear octree from a list of particles
+template <typename P>
+void make_linear_octree(linear_octree &tree, P &parts, size_t box_threshold){
+
+    vec llv = tree.p - vec(0.5, 0.5, 0.5) * tree.box_length;
+
+    // Sorting particles by key, the index rides along with its key
+    std::vector<std::pair<uint64_t, size_t>> sorted(parts.size());
+    for (size_t i = 0; i < parts.size(); ++i){
+        sorted[i] = std::make_pair(morton_key(particle_pos(parts, i), llv,
+                                              tree.box_length), i);
+    }
+    if (!sorted.empty()){
+        radix_sort(sorted);
+    }
+
+    tree.keys.resize(sorted.size());
+    tree.index.resize(sorted.size());
+    tree.rank.resize(sorted.size());
+    tree.x.resize(sorted.size());
+    tree.y.resize(sorted.size());
+    tree.z.resize(sorted.size());
+    tree.mass.resize(sorted.size());
+    for (size_t i = 0; i < sorted.size(); ++i){
+        tree.keys[i] = sorted[i].first;
+        tree.index[i] = sorted[i].second;
+        tree.rank[sorted[i].second] = i;
+
+        vec pos = particle_pos(parts, sorted[i].second);
+        tree.x[i] = pos.x;
+        tree.y[i] = pos.y;
+        tree.z[i] = pos.z;
+        tree.mass[i] = particle_mass(parts, sorted[i].second);
+    }
+
+    // Roughly 2 nodes per leaf-sized group of particles
+    tree.nodes.clear();
+    tree.nodes.reserve(2 * parts.size() / std::max(box_threshold, (size_t)1)
+                       + 1);
+    tree.leaves.clear();
+
+    lnode root;
+    root.p = tree.p;
+    root.box_length = tree.box_length;
+    root.begin = 0;
+    root.end = parts.size();
+    tree.nodes.push_back(root);
+
+    divide_linear_octree(tree, 0, 0, box_threshold);
+}
+
+// Divides a linear octree node and finds its center of mass
+// Note: tree.nodes may reallocate here, so nodes are only held by index
+void divide_linear_octree(linear_octree &tree, int curr, int level,
+                          size_t box_threshold){
+
+    size_t begin = tree.nodes[curr].begin;
+    size_t end = tree.nodes[curr].end;
+
+    // Leaf node, find the center of mass from the particles directly
+    if (end - begin <= box_threshold || level >= MORTON_BITS){
+        particle com(vec(), vec(), vec(), 0.0);
+        for (size_t i = begin; i < end; ++i){
+            com.p += vec(tree.x[i], tree.y[i], tree.z[i]) * tree.mass[i];
+            com.mass += tree.mass[i];
+        }
+        com.p /= com.mass;
+
+        sym_tensor quad;
+        for (size_t i = begin; i < end; ++i){
+            add_quadrupole(quad, vec(tree.x[i], tree.y[i], tree.z[i]) - com.p,
+                           tree.mass[i]);
+        }
+
+        tree.nodes[curr].com = com;
+        tree.nodes[curr].quad = quad;
+        tree.leaves.push_back(curr);
+        return;
+    }
+
+    int shift = 3 * (MORTON_BITS - 1 - level);
+    double node_length = tree.nodes[curr].box_length * 0.5;
+    double quarter_box = tree.nodes[curr].box_length * 0.25;
+    vec center = tree.nodes[curr].p;
+
+    // Keys in the range are sorted, so every octant is a contiguous block
+    size_t child_begin = begin;
+    for (int n = 0; n < 8; ++n){
+        size_t child_end = std::partition_point(
+            tree.keys.begin() + child_begin, tree.keys.begin() + end,
+            [shift, n](uint64_t key){ return (int)((key >> shift) & 7) <= n; })
+            - tree.keys.begin();
+
+        if (child_end > child_begin){
+            lnode child;
+            child.parent = curr;
+            child.box_length = node_length;
+            child.p.x = center.x + ((n & 1) ? 1 : -1) * quarter_box;
+            child.p.y = center.y + ((n & 2) ? 1 : -1) * quarter_box;
+            child.p.z = center.z + ((n & 4) ? 1 : -1) * quarter_box;
+            child.begin = child_begin;
+            child.end = child_end;
+
+            tree.nodes[curr].children[n] = tree.nodes.size();
+            tree.nodes.push_back(child);
+        }
+        child_begin = child_end;
+    }
+
+    // Recursing after all 8 octants are placed keeps siblings contiguous
+    particle com(vec(), vec(), vec(), 0.0);
+    for (int n = 0; n < 8; ++n){
+        int child = tree.nodes[curr].children[n];
+        if (child < 0){
+            continue;
+        }
+        divide_linear_octree(tree, child, level + 1, box_threshold);
+        com.p += tree.nodes[child].com.p * tree.nodes[child].com.mass;
+        com.mass += tree.nodes[child].com.mass;
+    }
+    com.p /= com.mass;
+
+    // Children's quadrupoles moved to the new center of mass
+    sym_tensor quad;
+    for (auto child : tree.nodes[curr].children){
+        if (child >= 0){
+            quad += tree.nodes[child].quad;
+            add_quadrupole(quad, tree.nodes[child].com.p - com.p,
+                           tree.nodes[child].com.mass);
+        }
+    }
+
+    tree.nodes[curr].com = com;
+    tree.nodes[curr].quad = quad;
+}
+
+// Function to check whether a position is within a linear octree node
+static bool in_box(const lnode &curr, vec pos){
+    double half_box = curr.box_length * 0.5;
+    return fabs(pos.x - curr.p.x) <= half_box &&
+           fabs(pos.y - curr.p.y) <= half_box &&
+           fabs(pos.z - curr.p.z) <= half_box;
+}
+
+// Acceleration on pos from the particles of a leaf, skipping pos itself
+static vec leaf_acc(const linear_octree &tree, const lnode &leaf, vec pos){
+    double eps2 = tree.softening * tree.softening;
+    vec acc;
+    for (size_t j = leaf.begin; j < leaf.end; ++j){
+        vec d = vec(tree.x[j], tree.y[j], tree.z[j]) - pos;
+        double r2 = dot(d, d);
+        if (r2 == 0.0){
+            continue;
+        }
+        double inverse_r = 1/sqrt(r2 + eps2);
+        acc += d * (G * tree.mass[j] * inverse_r * inverse_r * inverse_r);
+    }
+    return acc;
+}
+
+// Monopole and quadrupole acceleration of a node at offset d, softened.
+// The opening test still uses the true distance.
+static vec node_acc(const linear_octree &tree, const lnode &curr, vec d){
+    double inverse_r = 1/sqrt(dot(d, d)
+                              + tree.softening * tree.softening);
+    return d * (G * curr.com.mass * inverse_r * inverse_r * inverse_r)
+           + quadrupole_acc(curr.quad, d, inverse_r);
+}
+
+// Recursive function to find acceleration of particle in linear tree
+void RKsearch(const linear_octree &tree, int curr, particle *part){
+
+    if (curr < 0){
+        return;
+    }
+
+    const lnode &curr_node = tree.nodes[curr];
+
+    // Defining a few variables, distance and inverse_r (save those divisions)
+    vec d = curr_node.com.p - part->p;
+    double inverse_r = 1/length(d);
+
+    // Defining new theta of current node
+    double theta_2 = curr_node.box_length * inverse_r;
+
+    // find the new acceleration due to the current node
+    // A node holding the particle itself is always opened
+    if (theta_2 <= tree.theta && !in_box(curr_node, part->p)){
+        part->acc += node_acc(tree, curr_node, d);
+    }
+    else if (is_leaf(curr_node)){
+        part->acc += leaf_acc(tree, curr_node, part->p);
+    }
+    // if above thresh THETA, then search again.
+    else{
+        for (auto child : curr_node.children){
+            RKsearch(tree, child, part);
+        }
+    }
+}
+
+// RKsearch for a single particle of the SoA layout
+void RKsearch(const linear_octree &tree, int curr, particle_soa &parts,
+              size_t i){
+    particle part(particle_pos(parts, i), vec(), vec(), parts.mass[i]);
+    RKsearch(tree, curr, &part);
+    add_acc(parts, i, part.acc);
+}
+
+// Iterative version of RKsearch with an explicit stack, returns acceleration
+vec tree_walk(const linear_octree &tree, size_t i){
+
+    size_t slot = tree.rank[i];
+    vec pos(tree.x[slot], tree.y[slot], tree.z[slot]);
+
+    vec acc;
+    int stack[WALK_STACK];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0){
+        const lnode &curr_node = tree.nodes[stack[--top]];
+
+        vec d = curr_node.com.p - pos;
+        double inverse_r = 1/length(d);
+        double theta_2 = curr_node.box_length * inverse_r;
+
+        // A node holding the particle itself is always opened
+        bool holds_self = curr_node.begin <= slot && slot < curr_node.end;
+        if (theta_2 <= tree.theta && !holds_self){
+            acc += node_acc(tree, curr_node, d);
+        }
+        else if (is_leaf(curr_node)){
+            acc += leaf_acc(tree, curr_node, pos);
+        }
+        else{
+            // Pushed backwards so children are visited in RKsearch's order
+            for (int n = 7; n >= 0; --n){
+                if (curr_node.children[n] >= 0){
+                    stack[top++] = curr_node.children[n];
+                }
+            }
+        }
+    }
+
+    return acc;
+}
+
+void multipole_list::add(const lnode &curr){
+    x.push_back(curr.com.p.x);
+    y.push_back(curr.com.p.y);
+    z.push_back(curr.com.p.z);
+    mass.push_back(curr.com.mass);
+    xx.push_back(curr.quad.xx);
+    xy.push_back(curr.quad.xy);
+    xz.push_back(curr.quad.xz);
+    yy.push_back(curr.quad.yy);
+    yz.push_back(curr.quad.yz);
+    zz.push_back(curr.quad.zz);
+}
+
+void multipole_list::clear(){
+    for (auto arr : {&x, &y, &z, &mass, &xx, &xy, &xz, &yy, &yz, &zz}){
+        arr->clear();
+    }
+}
+
+// Far field of a bucket: monopole and quadrupole of every node in the list.
+// Same terms as RKsearch, written out per component so the inner loop is
+// vectorized by the compiler.
+void m2p(const multipole_list &far, const double *tx, const double *ty,
+         const double *tz, size_t nt, double eps2, double *ax, double *ay,
+         double *az){
+
+    const double *x = far.x.data(), *y = far.y.data(), *z = far.z.data();
+    const double *m = far.mass.data();
+    const double *xx = far.xx.data(), *xy = far.xy.data();
+    const double *xz = far.xz.data(), *yy = far.yy.data();
+    const double *yz = far.yz.data(), *zz = far.zz.data();
+
+    for (size_t i = 0; i < nt; ++i){
+        double acc_x = 0, acc_y = 0, acc_z = 0;
+
+        #pragma omp simd reduction(+:acc_x, acc_y, acc_z)
+        for (size_t j = 0; j < far.size(); ++j){
+            double dx = x[j] - tx[i];
+            double dy = y[j] - ty[i];
+            double dz = z[j] - tz[i];
+            double inverse_r2 = 1 / (dx * dx + dy * dy + dz * dz + eps2);
+            double inverse_r = sqrt(inverse_r2);
+            double inverse_r3 = inverse_r * inverse_r2;
+            double inverse_r5 = inverse_r3 * inverse_r2;
+
+            double qx = xx[j] * dx + xy[j] * dy + xz[j] * dz;
+            double qy = xy[j] * dx + yy[j] * dy + yz[j] * dz;
+            double qz = xz[j] * dx + yz[j] * dy + zz[j] * dz;
+            double dqd = dx * qx + dy * qy + dz * qz;
+
+            double f = m[j] * inverse_r3 + 2.5 * dqd * inverse_r5 * inverse_r2;
+            acc_x += f * dx - inverse_r5 * qx;
+            acc_y += f * dy - inverse_r5 * qy;
+            acc_z += f * dz - inverse_r5 * qz;
+        }
+
+        ax[i] += G * acc_x;
+        ay[i] += G * acc_y;
+        az[i] += G * acc_z;
+    }
+}
+
+// Builds the interaction lists of a leaf bucket: nodes that are far enough
+// from every particle in the leaf go into the far list as a multipole,
+// leaves that are too close go in particle by particle
+void leaf_interactions(const linear_octree &tree, int leaf,
+                       interaction_list &list, multipole_list &far){
+
+    const lnode &target = tree.nodes[leaf];
+
+    // Bounding sphere of the bucket, around the box center
+    double radius = 0;
+    for (size_t i = target.begin; i < target.end; ++i){
+        vec d = vec(tree.x[i], tree.y[i], tree.z[i]) - target.p;
+        radius = std::max(radius, dot(d, d));
+    }
+    radius = sqrt(radius);
+
+    list.clear();
+    far.clear();
+
+    int stack[WALK_STACK];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0){
+        int curr = stack[--top];
+        const lnode &curr_node = tree.nodes[curr];
+
+        // The closest any particle of the bucket can be to the com
+        double r = length(curr_node.com.p - target.p) - radius;
+        bool holds_target = curr_node.begin <= target.begin
+                            && target.end <= curr_node.end;
+
+        if (!holds_target && r > 0
+            && curr_node.box_length <= tree.theta * r){
+            far.add(curr_node);
+        }
+        else if (is_leaf(curr_node)){
+            for (size_t j = curr_node.begin; j < curr_node.end; ++j){
+                list.add(vec(tree.x[j], tree.y[j], tree.z[j]), tree.mass[j]);
+            }
+        }
+        else{
+            for (int n = 7; n >= 0; --n){
+                if (curr_node.children[n] >= 0){
+                    stack[top++] = curr_node.children[n];
+                }
+            }
+        }
+    }
+
+    list.pad();
+}
+
+// Adds the Morton ordered accelerations to the particles they belong to,
+// each thread owns a contiguous run of particles
+template <typename P>
+static void scatter_acc(const linear_octree &tree, P &parts){
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < parts.size(); ++i){
+        size_t slot = tree.rank[i];
+        add_acc(parts, i, vec(tree.ax[slot], tree.ay[slot], tree.az[slot]));
+    }
+}
+
+// Function to find the acceleration of all particles on all threads
+// Work is handed out leaf by leaf in Morton order, so every chunk is a
+// compact region of space and neighbouring walks touch the same nodes.
+template <typename P>
+void parallel_force(linear_octree &tree, P &parts){
+
+    double eps2 = tree.softening * tree.softening;
+    tree.ax.assign(tree.index.size(), 0.0);
+    tree.ay.assign(tree.index.size(), 0.0);
+    tree.az.assign(tree.index.size(), 0.0);
+
+    #pragma omp parallel
+    {
+        interaction_list list;
+        multipole_list far;
+        std::vector<double> acc_x, acc_y, acc_z;
+
+        #pragma omp for schedule(dynamic, 4)
+        for (size_t l = 0; l < tree.leaves.size(); ++l){
+            const lnode &leaf = tree.nodes[tree.leaves[l]];
+            size_t n = leaf.end - leaf.begin;
+
+            leaf_interactions(tree, tree.leaves[l], list, far);
+
+            // Summed privately, so the shared arrays are written only once
+            acc_x.assign(n, 0.0);
+            acc_y.assign(n, 0.0);
+            acc_z.assign(n, 0.0);
+            tree.kernel(&tree.x[leaf.begin], &tree.y[leaf.begin],
+                        &tree.z[leaf.begin], n, list, eps2,
+                        acc_x.data(), acc_y.data(), acc_z.data());
+            m2p(far, &tree.x[leaf.begin], &tree.y[leaf.begin],
+                &tree.z[leaf.begin], n, eps2,
+                acc_x.data(), acc_y.data(), acc_z.data());
+
+            for (size_t i = 0; i < n; ++i){
+                tree.ax[leaf.begin + i] = acc_x[i];
+                tree.ay[leaf.begin + i] = acc_y[i];
+                tree.az[leaf.begin + i] = acc_z[i];
+            }
+        }
+    }
+
+    scatter_acc(tree, parts);
+}
+
+// M2L: adds the field of the source node around the target node's center,
+// softened by eps2 like the near field
+static void m2l(const lnode &target, const lnode &source, double eps2,
+                local_expansion &local){
+    vec d = source.com.p - target.p;
+    double inverse_r = 1/sqrt(dot(d, d) + eps2);
+    double inverse_r2 = inverse_r * inverse_r;
+    double inverse_r3 = inverse_r2 * inverse_r;
+
+    local.acc += d * (G * source.com.mass * inverse_r3);
+    local.acc += quadrupole_acc(source.quad, d, inverse_r);
+
+    // Gradient of the monopole field: G M (3 d d - (r^2 + eps2) I) / s^5,
+    // add_quadrupole only has the r^2 part of the trace
+    double scale = G * source.com.mass * inverse_r3 * inverse_r2;
+    add_quadrupole(local.tidal, d, scale);
+    local.tidal.xx -= scale * eps2;
+    local.tidal.yy -= scale * eps2;
+    local.tidal.zz -= scale * eps2;
+}
+
+// Dual tree walk for every target node below target_root against the whole
+// tree. Well separated pairs become local expansions, pairs of leaves that
+// are too close are stored for the particle-particle pass.
+static void dual_walk(const linear_octree &tree, int target_root,
+                      std::vector<local_expansion> &local,
+                      std::vector<std::vector<int>> &near){
+
+    std::vector<std::pair<int, int>> stack;
+    stack.emplace_back(target_root, 0);
+
+    while (!stack.empty()){
+        int a = stack.back().first;
+        int b = stack.back().second;
+        stack.pop_back();
+
+        const lnode &target = tree.nodes[a];
+        const lnode &source = tree.nodes[b];
+
+        bool disjoint = target.end <= source.begin
+                        || source.end <= target.begin;
+        double r = length(source.com.p - target.p);
+
+        if (disjoint
+            && target.box_length + source.box_length <= tree.theta * r){
+            m2l(target, source, tree.softening * tree.softening,
+                local[a]);
+        }
+        else if (is_leaf(target) && is_leaf(source)){
+            near[a].push_back(b);
+        }
+        // Always open the bigger of the two, targets stay below target_root
+        else if (is_leaf(target) || (!is_leaf(source)
+                 && source.box_length > target.box_length)){
+            for (auto child : source.children){
+                if (child >= 0){
+                    stack.emplace_back(a, child);
+                }
+            }
+        }
+        else{
+            for (auto child : target.children){
+                if (child >= 0){
+                    stack.emplace_back(child, b);
+                }
+            }
+        }
+    }
+}
+
+// Dual tree (FMM style) evaluation of the acceleration of all particles
+template <typename P>
+void fmm_force(linear_octree &tree, P &parts){
+
+    size_t n_parts = tree.index.size();
+    double eps2 = tree.softening * tree.softening;
+    tree.ax.assign(n_parts, 0.0);
+    tree.ay.assign(n_parts, 0.0);
+    tree.az.assign(n_parts, 0.0);
+
+    std::vector<local_expansion> local(tree.nodes.size());
+    std::vector<std::vector<int>> near(tree.nodes.size());
+
+    // Splitting the targets into disjoint subtrees, one task each, so no two
+    // threads ever write to the same expansion or near list
+    std::vector<int> target_roots;
+    size_t cutoff = std::max(n_parts / 256, (size_t)1);
+    std::vector<int> todo(1, 0);
+    while (!todo.empty()){
+        int curr = todo.back();
+        todo.pop_back();
+        const lnode &curr_node = tree.nodes[curr];
+        if (is_leaf(curr_node) || curr_node.end - curr_node.begin <= cutoff){
+            target_roots.push_back(curr);
+            continue;
+        }
+        for (auto child : curr_node.children){
+            if (child >= 0){
+                todo.push_back(child);
+            }
+        }
+    }
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (size_t t = 0; t < target_roots.size(); ++t){
+        dual_walk(tree, target_roots[t], local, near);
+    }
+
+    // L2L: children come after their parents in the node array
+    for (size_t i = 1; i < tree.nodes.size(); ++i){
+        const lnode &curr_node = tree.nodes[i];
+        const lnode &parent = tree.nodes[curr_node.parent];
+        local[i].acc += local[curr_node.parent].acc
+                        + local[curr_node.parent].tidal
+                          * (curr_node.p - parent.p);
+        local[i].tidal += local[curr_node.parent].tidal;
+    }
+
+    #pragma omp parallel
+    {
+        interaction_list list;
+        std::vector<double> acc_x, acc_y, acc_z;
+
+        #pragma omp for schedule(dynamic, 4)
+        for (size_t l = 0; l < tree.leaves.size(); ++l){
+            int curr = tree.leaves[l];
+            const lnode &leaf = tree.nodes[curr];
+            size_t n = leaf.end - leaf.begin;
+
+            // L2P
+            acc_x.resize(n);
+            acc_y.resize(n);
+            acc_z.resize(n);
+            for (size_t i = 0; i < n; ++i){
+                size_t j = leaf.begin + i;
+                vec acc = local[curr].acc + local[curr].tidal
+                          * (vec(tree.x[j], tree.y[j], tree.z[j]) - leaf.p);
+                acc_x[i] = acc.x;
+                acc_y[i] = acc.y;
+                acc_z[i] = acc.z;
+            }
+
+            // P2P with the leaves that were too close
+            list.clear();
+            for (auto source : near[curr]){
+                for (size_t j = tree.nodes[source].begin;
+                     j < tree.nodes[source].end; ++j){
+                    list.add(vec(tree.x[j], tree.y[j], tree.z[j]),
+                             tree.mass[j]);
+                }
+            }
+            list.pad();
+            tree.kernel(&tree.x[leaf.begin], &tree.y[leaf.begin],
+                        &tree.z[leaf.begin], n, list, eps2,
+                        acc_x.data(), acc_y.data(), acc_z.data());
+
+            for (size_t i = 0; i < n; ++i){
+                tree.ax[leaf.begin + i] = acc_x[i];
+                tree.ay[leaf.begin + i] = acc_y[i];
+                tree.az[leaf.begin + i] = acc_z[i];
+            }
+        }
+    }
+
+    scatter_acc(tree, parts);
+}
+
+// Function to find acceleration of particles in linear Barnes Hut tree
+void force_integrate(linear_octree &tree, std::vector<particle> &p_vec,
+                     double dt){
+
+    parallel_force(tree, p_vec);
+
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < p_vec.size(); ++i){
+        RK4(&p_vec[i], dt);
+    }
+}
+
+void force_integrate(linear_octree &tree, particle_soa &parts, double dt){
+    parallel_force(tree, parts);
+    RK4(parts, dt);
+}
+
+/*----------------------------------------------------------------------------//
+* TEMPLATE INSTANTIATIONS
+*-----------------------------------------------------------------------------*/
+
+template void fit_linear_octree(linear_octree &tree,
+                                const std::vector<particle> &parts);
+template void fit_linear_octree(linear_octree &tree,
+                                const particle_soa &parts);
+
+template void make_linear_octree(linear_octree &tree,
+                                 std::vector<particle> &parts,
+                                 size_t box_threshold);
+template void make_linear_octree(linear_octree &tree, particle_soa &parts,
+                                 size_t box_threshold);
+
+template void parallel_force(linear_octree &tree,
+                             std::vector<particle> &parts);
+template void parallel_force(linear_octree &tree, particle_soa &parts);
+
+template void fmm_force(linear_octree &tree, std::vector<particle> &parts);
+template void fmm_force(linear_octree &tree, particle_soa &parts);
@@ -0,0 +1,185 @@
+/*-------------linear_octree.h------------------------------------------------//
+*
+* Purpose: Header file for linear_octree.cpp, a flat (pointer-free) octree
+*          built from particles sorted along a Morton (Z-order) curve
+*
+*   Notes: The node ordering and centers of mass match the ones produced by
+*          make_octree / divide_octree, so the same search can run on both.
+*          Builders and the force pass are templates over the particle
+*          storage, instantiated for std::vector<particle> and particle_soa
+*
+*-----------------------------------------------------------------------------*/
+
+#ifndef LINEAR_OCTREE_H
+#define LINEAR_OCTREE_H
+
+#include <cstdint>
+#include "aligned_allocator.h"
+#include "barnes_hut.h"
+#include "p2p_kernel.h"
+#include "particle_soa.h"
+
+/*----------------------------------------------------------------------------//
+* STRUCTS
+*-----------------------------------------------------------------------------*/
+
+// Number of bits used per dimension in the Morton key (3 * 21 = 63 bits)
+const int MORTON_BITS = 21;
+
+// Size of the explicit stack for the iterative walk, at most 7 siblings are
+// left waiting on each level while the 8th is being searched
+const int WALK_STACK = 8 * (MORTON_BITS + 1);
+
+// Default number of particles per leaf bucket. Anything from 8 to 64 works,
+// larger buckets mean a shallower tree and longer runs in the SIMD kernels
+const size_t LEAF_BUCKET = 16;
+
+// struct for linear octree nodes
+struct lnode {
+    // Position of node / box
+    vec p;
+    double box_length;
+    int parent;
+
+    // Same ordering as node::children, indices into linear_octree::nodes
+    // Empty octants are not stored and are marked with -1
+    std::array<int, 8> children;
+
+    // Range [begin, end) of the particles in linear_octree::index
+    size_t begin, end;
+
+    particle com;
+
+    // Quadrupole moment around com.p
+    sym_tensor quad;
+
+    lnode() : p(0, 0, 0), box_length(1.0), parent(-1), begin(0), end(0),
+              com(vec(), vec(), vec(), 0.0) {
+        children.fill(-1);
+    }
+};
+
+inline bool is_leaf(const lnode &curr){
+    for (auto child : curr.children){
+        if (child >= 0){
+            return false;
+        }
+    }
+    return true;
+}
+
+// Far field seen by one leaf bucket, in SoA form for m2p
+struct multipole_list {
+    aligned_vector<double> x, y, z, mass;
+    aligned_vector<double> xx, xy, xz, yy, yz, zz;
+
+    size_t size() const {
+        return x.size();
+    }
+
+    void add(const lnode &curr);
+    void clear();
+};
+
+// Local expansion of the far field around a node center, used by the dual
+// tree walk: a(x) = acc + tidal * (x - p)
+struct local_expansion {
+    vec acc;
+    sym_tensor tidal;
+};
+
+// Flat octree, the root is always nodes[0]
+struct linear_octree {
+    // Position and size of the root box
+    vec p;
+    double box_length;
+
+    std::vector<lnode> nodes;
+
+    // Morton keys and particle indices, both sorted by key
+    std::vector<uint64_t> keys;
+    std::vector<size_t> index;
+
+    // Position of every particle in index (the inverse of index)
+    std::vector<size_t> rank;
+
+    // Leaf nodes, in Morton order
+    std::vector<int> leaves;
+
+    // Copies of positions and masses in Morton order, so a leaf is one
+    // contiguous run in each array
+    aligned_vector<double> x, y, z, mass;
+
+    // Accelerations found by the force pass, in Morton order
+    aligned_vector<double> ax, ay, az;
+
+    // Kernel for the leaf interactions, the best one for this CPU by default
+    p2p_fn kernel;
+
+    // Opening angle used by every walk over this tree
+    double theta;
+
+    // Plummer softening of every force found with this tree, near and far
+    double softening;
+
+    linear_octree() : p(0, 0, 0), box_length(1.0),
+                      kernel(select_p2p_kernel()), theta(THETA),
+                      softening(SOFTENING) {}
+    linear_octree(vec loc, double length) : p(loc), box_length(length),
+                                            kernel(select_p2p_kernel()),
+                                            theta(THETA),
+                                            softening(SOFTENING) {}
+};
+
+// Function to find the 63-bit Morton key of a position within a box
+uint64_t morton_key(vec pos, vec llv, double box_length);
+
+// Sets the root box to the bounding cube of the particles, if any
+template <typename P>
+void fit_linear_octree(linear_octree &tree, const P &parts);
+
+// Builds the whole linear octree from a list of particles. Leaves hold at
+// most box_threshold particles (unless MORTON_BITS levels are reached)
+template <typename P>
+void make_linear_octree(linear_octree &tree, P &parts, size_t box_threshold);
+
+// Divides a linear octree node and finds its center of mass
+void divide_linear_octree(linear_octree &tree, int curr, int level,
+                          size_t box_threshold);
+
+// Recursive function to find acceleration of particle in linear tree
+void RKsearch(const linear_octree &tree, int curr, particle *part);
+void RKsearch(const linear_octree &tree, int curr, particle_soa &parts,
+              size_t i);
+
+// Iterative version of RKsearch with an explicit stack, returns the
+// acceleration of particle i of the parts the tree was built from. Nodes
+// holding it are told by its place in the index, not by its position.
+vec tree_walk(const linear_octree &tree, size_t i);
+
+// Builds the near (particles) and far (multipoles) lists of a leaf bucket
+void leaf_interactions(const linear_octree &tree, int leaf,
+                       interaction_list &list, multipole_list &far);
+
+// Adds the acceleration from every multipole in the far list to the
+// targets, softened by eps2 like the kernels
+void m2p(const multipole_list &far, const double *tx, const double *ty,
+         const double *tz, size_t nt, double eps2, double *ax, double *ay,
+         double *az);
+
+// Function to find the acceleration of all particles on all threads
+template <typename P>
+void parallel_force(linear_octree &tree, P &parts);
+
+// Dual tree (FMM style) alternative to parallel_force. Node pairs that are
+// well separated interact once through a local expansion (field and tidal
+// tensor) that is passed down to the leaves.
+template <typename P>
+void fmm_force(linear_octree &tree, P &parts);
+
+// Function to find acceleration of particles in linear Barnes Hut tree
+void force_integrate(linear_octree &tree, std::vector<particle> &p_vec,
+                     double dt);
+void force_integrate(linear_octree &tree, particle_soa &parts, double dt);
+
+#endif
@@ -0,0 +1,188 @@
+/*-------------p2p_kernel.cpp-------------------------------------------------//
+*
+* Purpose: Particle-particle interaction kernels for leaf buckets, with a
+*          scalar version and AVX2 / AVX-512 versions picked at runtime
+*
+*   Notes: The SIMD kernels are compiled with target attributes, so this file
+*          builds without -mavx flags and the choice is made by the CPU that
+*          actually runs the code, not the one that compiled it.
+*          The AVX2 estimate goes through single precision, so r^2 + eps2 has
+*          to fit in a float (about 1e-38 to 1e38), true for any sane box.
+*
+*-----------------------------------------------------------------------------*/
+
+#include <immintrin.h>
+#include "barnes_hut.h"
+#include "p2p_kernel.h"
+
+/*----------------------------------------------------------------------------//
+* SUBROUTINES
+*-----------------------------------------------------------------------------*/
+
+void interaction_list::pad(){
+    if (x.empty()){
+        return;
+    }
+
+    vec last(x.back(), y.back(), z.back());
+    while (x.size() % SIMD_WIDTH != 0){
+        add(last, 0.0);
+    }
+}
+
+void p2p_scalar(const double *tx, const double *ty, const double *tz,
+                size_t nt, const interaction_list &src, double eps2,
+                double *ax, double *ay, double *az){
+
+    const double *sx = src.x.data(), *sy = src.y.data(), *sz = src.z.data();
+    const double *sm = src.mass.data();
+
+    for (size_t i = 0; i < nt; ++i){
+        double acc_x = 0, acc_y = 0, acc_z = 0;
+        for (size_t j = 0; j < src.size(); ++j){
+            double dx = sx[j] - tx[i];
+            double dy = sy[j] - ty[i];
+            double dz = sz[j] - tz[i];
+            double r2 = dx * dx + dy * dy + dz * dz;
+            if (r2 == 0.0){
+                continue;
+            }
+            double inverse_r = 1 / sqrt(r2 + eps2);
+            double f = sm[j] * inverse_r * inverse_r * inverse_r;
+            acc_x += dx * f;
+            acc_y += dy * f;
+            acc_z += dz * f;
+        }
+        ax[i] += G * acc_x;
+        ay[i] += G * acc_y;
+        az[i] += G * acc_z;
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static double hsum(__m256d v){
+    __m128d lo = _mm256_castpd256_pd128(v);
+    __m128d hi = _mm256_extractf128_pd(v, 1);
+    lo = _mm_add_pd(lo, hi);
+    return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+__attribute__((target("avx2,fma")))
+void p2p_avx2(const double *tx, const double *ty, const double *tz,
+              size_t nt, const interaction_list &src, double eps2,
+              double *ax, double *ay, double *az){
+
+    const double *sx = src.x.data(), *sy = src.y.data(), *sz = src.z.data();
+    const double *sm = src.mass.data();
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d three_halves = _mm256_set1_pd(1.5);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d soft = _mm256_set1_pd(eps2);
+
+    for (size_t i = 0; i < nt; ++i){
+        __m256d px = _mm256_set1_pd(tx[i]);
+        __m256d py = _mm256_set1_pd(ty[i]);
+        __m256d pz = _mm256_set1_pd(tz[i]);
+        __m256d acc_x = zero, acc_y = zero, acc_z = zero;
+
+        // The list is padded to SIMD_WIDTH, so 4 always divides its size
+        for (size_t j = 0; j < src.size(); j += 4){
+            __m256d dx = _mm256_sub_pd(_mm256_load_pd(sx + j), px);
+            __m256d dy = _mm256_sub_pd(_mm256_load_pd(sy + j), py);
+            __m256d dz = _mm256_sub_pd(_mm256_load_pd(sz + j), pz);
+            __m256d r2 = _mm256_mul_pd(dx, dx);
+            r2 = _mm256_fmadd_pd(dy, dy, r2);
+            r2 = _mm256_fmadd_pd(dz, dz, r2);
+            __m256d s2 = _mm256_add_pd(r2, soft);
+
+            // 12-bit estimate, then y = y * (1.5 - 0.5 * s2 * y * y)
+            __m256d y = _mm256_cvtps_pd(_mm_rsqrt_ps(_mm256_cvtpd_ps(s2)));
+            __m256d y2 = _mm256_mul_pd(y, y);
+            y = _mm256_mul_pd(y, _mm256_fnmadd_pd(_mm256_mul_pd(half, s2), y2,
+                                                  three_halves));
+
+            // r = 0 gives inf / nan above, those lanes are dropped here
+            __m256d valid = _mm256_cmp_pd(r2, zero, _CMP_GT_OQ);
+            __m256d f = _mm256_mul_pd(_mm256_mul_pd(y, y), y);
+            f = _mm256_and_pd(valid,
+                              _mm256_mul_pd(f, _mm256_load_pd(sm + j)));
+
+            acc_x = _mm256_fmadd_pd(dx, f, acc_x);
+            acc_y = _mm256_fmadd_pd(dy, f, acc_y);
+            acc_z = _mm256_fmadd_pd(dz, f, acc_z);
+        }
+
+        ax[i] += G * hsum(acc_x);
+        ay[i] += G * hsum(acc_y);
+        az[i] += G * hsum(acc_z);
+    }
+}
+
+// Plain horizontal sum, _mm512_reduce_add_pd trips -Wmaybe-uninitialized
+__attribute__((target("avx512f")))
+static double hsum(__m512d v){
+    alignas(64) double lanes[8];
+    _mm512_store_pd(lanes, v);
+    return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3]))
+           + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+}
+
+__attribute__((target("avx512f")))
+void p2p_avx512(const double *tx, const double *ty, const double *tz,
+                size_t nt, const interaction_list &src, double eps2,
+                double *ax, double *ay, double *az){
+
+    const double *sx = src.x.data(), *sy = src.y.data(), *sz = src.z.data();
+    const double *sm = src.mass.data();
+    const __m512d half = _mm512_set1_pd(0.5);
+    const __m512d three_halves = _mm512_set1_pd(1.5);
+    const __m512d zero = _mm512_setzero_pd();
+    const __m512d soft = _mm512_set1_pd(eps2);
+
+    for (size_t i = 0; i < nt; ++i){
+        __m512d px = _mm512_set1_pd(tx[i]);
+        __m512d py = _mm512_set1_pd(ty[i]);
+        __m512d pz = _mm512_set1_pd(tz[i]);
+        __m512d acc_x = zero, acc_y = zero, acc_z = zero;
+
+        for (size_t j = 0; j < src.size(); j += 8){
+            __m512d dx = _mm512_sub_pd(_mm512_load_pd(sx + j), px);
+            __m512d dy = _mm512_sub_pd(_mm512_load_pd(sy + j), py);
+            __m512d dz = _mm512_sub_pd(_mm512_load_pd(sz + j), pz);
+            __m512d r2 = _mm512_mul_pd(dx, dx);
+            r2 = _mm512_fmadd_pd(dy, dy, r2);
+            r2 = _mm512_fmadd_pd(dz, dz, r2);
+            __m512d s2 = _mm512_add_pd(r2, soft);
+
+            // 14-bit estimate, then y = y * (1.5 - 0.5 * s2 * y * y)
+            __m512d y = _mm512_maskz_rsqrt14_pd(0xff, s2);
+            __m512d y2 = _mm512_mul_pd(y, y);
+            y = _mm512_mul_pd(y, _mm512_fnmadd_pd(_mm512_mul_pd(half, s2), y2,
+                                                  three_halves));
+
+            __mmask8 valid = _mm512_cmp_pd_mask(r2, zero, _CMP_GT_OQ);
+            __m512d f = _mm512_mul_pd(_mm512_mul_pd(y, y), y);
+            f = _mm512_maskz_mul_pd(valid, f, _mm512_load_pd(sm + j));
+
+            acc_x = _mm512_fmadd_pd(dx, f, acc_x);
+            acc_y = _mm512_fmadd_pd(dy, f, acc_y);
+            acc_z = _mm512_fmadd_pd(dz, f, acc_z);
+        }
+
+        ax[i] += G * hsum(acc_x);
+        ay[i] += G * hsum(acc_y);
+        az[i] += G * hsum(acc_z);
+    }
+}
+
+// Function to pick the widest kernel the running CPU supports
+p2p_fn select_p2p_kernel(){
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")){
+        return p2p_avx512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")){
+        return p2p_avx2;
+    }
+    return p2p_scalar;
+}
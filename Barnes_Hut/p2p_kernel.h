@@ -0,0 +1,76 @@
+/*-------------p2p_kernel.h---------------------------------------------------//
+*
+* Purpose: Header file for p2p_kernel.cpp, the particle-particle kernels used
+*          for the near field of a leaf bucket
+*
+*   Notes: Sources are the leaf's interaction list: particles from nearby
+*          leaves plus centers of mass of nodes far enough away. The AVX
+*          kernels use the hardware rsqrt estimate and one Newton-Raphson
+*          step, so 1/r is good to roughly 1e-7 (AVX2) or 1e-8 (AVX-512)
+*          relative error. That is well below the Barnes Hut error itself.
+*
+*-----------------------------------------------------------------------------*/
+
+#ifndef P2P_KERNEL_H
+#define P2P_KERNEL_H
+
+#include "aligned_allocator.h"
+#include "vec.h"
+
+/*----------------------------------------------------------------------------//
+* STRUCTS
+*-----------------------------------------------------------------------------*/
+
+// Widest SIMD register in doubles, interaction lists are padded to this
+const size_t SIMD_WIDTH = 8;
+
+// Sources seen by one leaf bucket, in SoA form for the kernels
+struct interaction_list {
+    aligned_vector<double> x, y, z, mass;
+
+    size_t size() const {
+        return x.size();
+    }
+
+    void clear() {
+        x.clear();
+        y.clear();
+        z.clear();
+        mass.clear();
+    }
+
+    void add(vec p, double m) {
+        x.push_back(p.x);
+        y.push_back(p.y);
+        z.push_back(p.z);
+        mass.push_back(m);
+    }
+
+    // Pads with massless copies of the last source up to a multiple of
+    // SIMD_WIDTH, so the kernels never need a remainder loop
+    void pad();
+};
+
+// Kernel signature: targets (tx, ty, tz)[0, nt) get
+// G * sum m d / (r^2 + eps2)^(3/2) from every source in the list added to
+// (ax, ay, az). Sources at r = 0 (the target itself) are skipped.
+using p2p_fn = void (*)(const double *tx, const double *ty, const double *tz,
+                        size_t nt, const interaction_list &src, double eps2,
+                        double *ax, double *ay, double *az);
+
+void p2p_scalar(const double *tx, const double *ty, const double *tz,
+                size_t nt, const interaction_list &src, double eps2,
+                double *ax, double *ay, double *az);
+
+void p2p_avx2(const double *tx, const double *ty, const double *tz,
+              size_t nt, const interaction_list &src, double eps2,
+              double *ax, double *ay, double *az);
+
+void p2p_avx512(const double *tx, const double *ty, const double *tz,
+                size_t nt, const interaction_list &src, double eps2,
+                double *ax, double *ay, double *az);
+
+// Function to pick the widest kernel the running CPU supports
+p2p_fn select_p2p_kernel();
+
+#endif
@@ -0,0 +1,86 @@
+/*-------------particle_soa.cpp-----------------------------------------------//
+*
+* Purpose: Conversions between the AoS and SoA particle layouts and the
+*          integrator for the SoA layout
+*
+*-----------------------------------------------------------------------------*/
+
+#include "particle_soa.h"
+
+/*----------------------------------------------------------------------------//
+* SUBROUTINES
+*-----------------------------------------------------------------------------*/
+
+particle_soa::particle_soa(const std::vector<particle> &p_vec){
+    resize(p_vec.size());
+    for (size_t i = 0; i < p_vec.size(); ++i){
+        set(i, p_vec[i]);
+    }
+}
+
+void particle_soa::reserve(size_t n){
+    for (auto arr : {&x, &y, &z, &vx, &vy, &vz, &ax, &ay, &az, &mass}){
+        arr->reserve(n);
+    }
+}
+
+void particle_soa::resize(size_t n){
+    for (auto arr : {&x, &y, &z, &vx, &vy, &vz, &ax, &ay, &az, &mass}){
+        arr->resize(n);
+    }
+}
+
+void particle_soa::push_back(const particle &part){
+    resize(size() + 1);
+    set(size() - 1, part);
+}
+
+particle particle_soa::get(size_t i) const{
+    return particle(vec(x[i], y[i], z[i]), vec(vx[i], vy[i], vz[i]),
+                    vec(ax[i], ay[i], az[i]), mass[i]);
+}
+
+void particle_soa::set(size_t i, const particle &part){
+    x[i] = part.p.x;
+    y[i] = part.p.y;
+    z[i] = part.p.z;
+    vx[i] = part.vel.x;
+    vy[i] = part.vel.y;
+    vz[i] = part.vel.z;
+    ax[i] = part.acc.x;
+    ay[i] = part.acc.y;
+    az[i] = part.acc.z;
+    mass[i] = part.mass;
+}
+
+// Function to copy the SoA particles back into an AoS vector
+void to_aos(const particle_soa &parts, std::vector<particle> &p_vec){
+    p_vec.resize(parts.size());
+    for (size_t i = 0; i < parts.size(); ++i){
+        // radius is not stored in the SoA layout
+        double radius = p_vec[i].radius;
+        p_vec[i] = parts.get(i);
+        p_vec[i].radius = radius;
+    }
+}
+
+// Runge-Kutta 4 for all particles at once, same stages as RK4(particle*)
+// One component at a time, so every loop is a straight run over 3 arrays
+void RK4(particle_soa &parts, double dt){
+    auto step = [dt](double *pos, double *vel, const double *acc, size_t n){
+        #pragma omp parallel for simd schedule(static)
+        for (size_t i = 0; i < n; ++i){
+            double vel1 = vel[i] + 0.5 * dt * acc[i];
+            double vel2 = vel[i] + 0.5 * acc[i] * dt;
+            double vel3 = vel[i] + acc[i] * dt;
+
+            pos[i] = pos[i] + (dt / 6) * (vel[i] + 2 * vel1 + 2 * vel2 + vel3);
+            vel[i] = vel[i] + (dt / 6) * (acc[i] + 2 * acc[i] + 2 * acc[i]
+                                          + acc[i]);
+        }
+    };
+
+    step(parts.x.data(), parts.vx.data(), parts.ax.data(), parts.size());
+    step(parts.y.data(), parts.vy.data(), parts.ay.data(), parts.size());
+    step(parts.z.data(), parts.vz.data(), parts.az.data(), parts.size());
+}
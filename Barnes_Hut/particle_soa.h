@@ -0,0 +1,81 @@
+/*-------------particle_soa.h-------------------------------------------------//
+*
+* Purpose: Structure-of-arrays storage for particles. Each component lives in
+*          its own cache line aligned array, so a loop over positions only
+*          pulls positions into cache and can be vectorized.
+*
+*   Notes: std::vector<particle> is still the default, the small accessors at
+*          the bottom let templated code (the linear octree) use either one
+*
+*-----------------------------------------------------------------------------*/
+
+#ifndef PARTICLE_SOA_H
+#define PARTICLE_SOA_H
+
+#include "aligned_allocator.h"
+#include "barnes_hut.h"
+
+/*----------------------------------------------------------------------------//
+* STRUCTS
+*-----------------------------------------------------------------------------*/
+
+struct particle_soa {
+    aligned_vector<double> x, y, z;
+    aligned_vector<double> vx, vy, vz;
+    aligned_vector<double> ax, ay, az;
+    aligned_vector<double> mass;
+
+    particle_soa() = default;
+    explicit particle_soa(const std::vector<particle> &p_vec);
+
+    size_t size() const {
+        return x.size();
+    }
+
+    void reserve(size_t n);
+    void resize(size_t n);
+
+    void push_back(const particle &part);
+
+    // Copies a single particle in and out of AoS form
+    particle get(size_t i) const;
+    void set(size_t i, const particle &part);
+};
+
+// Function to copy the SoA particles back into an AoS vector
+void to_aos(const particle_soa &parts, std::vector<particle> &p_vec);
+
+// Runge-Kutta 4 for all particles at once, same stages as RK4(particle*)
+void RK4(particle_soa &parts, double dt);
+
+/*----------------------------------------------------------------------------//
+* ACCESSORS
+*-----------------------------------------------------------------------------*/
+
+inline vec particle_pos(const std::vector<particle> &p_vec, size_t i){
+    return p_vec[i].p;
+}
+
+inline vec particle_pos(const particle_soa &parts, size_t i){
+    return vec(parts.x[i], parts.y[i], parts.z[i]);
+}
+
+inline double particle_mass(const std::vector<particle> &p_vec, size_t i){
+    return p_vec[i].mass;
+}
+
+inline double particle_mass(const particle_soa &parts, size_t i){
+    return parts.mass[i];
+}
+
+inline void add_acc(std::vector<particle> &p_vec, size_t i, vec acc){
+    p_vec[i].acc += acc;
+}
+
+inline void add_acc(particle_soa &parts, size_t i, vec acc){
+    parts.ax[i] += acc.x;
+    parts.ay[i] += acc.y;
+    parts.az[i] += acc.z;
+}
+
+#endif
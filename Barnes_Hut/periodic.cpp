@@ -0,0 +1,206 @@
+/*-------------periodic.cpp---------------------------------------------------//
+*
+* Purpose: Periodic boundaries for the linear octree, nearest image walk
+*          plus a tabulated Ewald correction
+*
+*   Notes: The Ewald sum follows Hernquist, Bouchet & Suto (1991). The
+*          correction is odd in each component of the offset, so the table
+*          only holds the octant with all components positive.
+*
+*-----------------------------------------------------------------------------*/
+
+#include "periodic.h"
+
+/*----------------------------------------------------------------------------//
+* SUBROUTINES
+*-----------------------------------------------------------------------------*/
+
+// Ewald correction evaluated directly, x is in units of the box. Returns
+// the periodic acceleration towards a unit mass at offset x (G = 1) minus
+// that of its nearest image alone.
+vec ewald_correction(vec x){
+    double r2 = dot(x, x);
+    if (r2 == 0.0){
+        return vec();
+    }
+
+    const double alpha = EWALD_ALPHA;
+    const double pi = M_PI;
+
+    // Taking the nearest image back out
+    vec acc = -x / (r2 * sqrt(r2));
+
+    // Real space sum, screened by erfc
+    for (int i = -EWALD_IMAGES; i <= EWALD_IMAGES; ++i){
+        for (int j = -EWALD_IMAGES; j <= EWALD_IMAGES; ++j){
+            for (int k = -EWALD_IMAGES; k <= EWALD_IMAGES; ++k){
+                vec d = x - vec(i, j, k);
+                double r = length(d);
+                double val = erfc(alpha * r) + 2 * alpha * r / sqrt(pi)
+                             * exp(-alpha * alpha * r * r);
+                acc += d * (val / (r * r * r));
+            }
+        }
+    }
+
+    // Fourier space sum
+    for (int i = -EWALD_IMAGES; i <= EWALD_IMAGES; ++i){
+        for (int j = -EWALD_IMAGES; j <= EWALD_IMAGES; ++j){
+            for (int k = -EWALD_IMAGES; k <= EWALD_IMAGES; ++k){
+                vec h(i, j, k);
+                double h2 = dot(h, h);
+                if (h2 == 0.0){
+                    continue;
+                }
+                double val = 2.0 / h2 * exp(-pi * pi * h2 / (alpha * alpha))
+                             * sin(2 * pi * dot(h, x));
+                acc += h * val;
+            }
+        }
+    }
+
+    return acc;
+}
+
+// Fills the table for a box, this takes a moment so do it once
+void make_ewald_table(ewald_table &ewald, double box_length, int n){
+    ewald.box_length = box_length;
+    ewald.n = n;
+    ewald.corr.resize(n * n * n);
+
+    double spacing = 0.5 / (n - 1);
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int i = 0; i < n; ++i){
+        for (int j = 0; j < n; ++j){
+            for (int k = 0; k < n; ++k){
+                ewald.corr[(i * n + j) * n + k]
+                    = ewald_correction(vec(i, j, k) * spacing);
+            }
+        }
+    }
+}
+
+// Correction to the acceleration towards a unit mass at offset d (the
+// nearest image), trilinear in the table
+vec ewald_table::acc(vec d) const{
+    double scale = 2.0 * (n - 1) / box_length;
+    double u[3] = {fabs(d.x) * scale, fabs(d.y) * scale, fabs(d.z) * scale};
+
+    int cell[3];
+    double frac[3];
+    for (int c = 0; c < 3; ++c){
+        cell[c] = std::min((int)u[c], n - 2);
+        frac[c] = std::min(u[c] - cell[c], 1.0);
+    }
+
+    vec corr_sum;
+    for (int corner = 0; corner < 8; ++corner){
+        int di = corner & 1, dj = (corner >> 1) & 1, dk = (corner >> 2) & 1;
+        double weight = (di ? frac[0] : 1 - frac[0])
+                        * (dj ? frac[1] : 1 - frac[1])
+                        * (dk ? frac[2] : 1 - frac[2]);
+        corr_sum += weight * corr[((cell[0] + di) * n + cell[1] + dj) * n
+                                  + cell[2] + dk];
+    }
+
+    double units = G / (box_length * box_length);
+    return vec(d.x < 0 ? -corr_sum.x : corr_sum.x,
+               d.y < 0 ? -corr_sum.y : corr_sum.y,
+               d.z < 0 ? -corr_sum.z : corr_sum.z) * units;
+}
+
+// Moves every particle back into the box around center
+void wrap_positions(std::vector<particle> &p_vec, vec center,
+                    double box_length){
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < p_vec.size(); ++i){
+        p_vec[i].p = center + min_image(p_vec[i].p - center, box_length);
+    }
+}
+
+// Function to check whether a node holds pos or one of its images
+static bool in_box(const lnode &curr, vec pos, double box_length){
+    double half_box = curr.box_length * 0.5;
+    vec d = min_image(pos - curr.p, box_length);
+    return fabs(d.x) <= half_box && fabs(d.y) <= half_box
+           && fabs(d.z) <= half_box;
+}
+
+// Acceleration at pos from the periodic tree. A node is used as a whole
+// only if it passes the usual opening test and the nearest image of all of
+// it is the same one, i.e. it reaches less than half a box from pos.
+vec periodic_walk(const linear_octree &tree, const ewald_table &ewald,
+                  vec pos){
+
+    double box_length = tree.box_length;
+    double half_period = 0.5 * box_length;
+    double eps2 = tree.softening * tree.softening;
+
+    vec acc;
+    int stack[WALK_STACK];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0){
+        const lnode &curr_node = tree.nodes[stack[--top]];
+
+        vec d = min_image(curr_node.com.p - pos, box_length);
+        double r = length(d);
+        double inverse_r = 1/r;
+        double reach = curr_node.box_length;
+        bool one_image = fabs(d.x) + reach <= half_period
+                         && fabs(d.y) + reach <= half_period
+                         && fabs(d.z) + reach <= half_period;
+
+        // Softened like the open walk, the Ewald part is far field only
+        if (curr_node.box_length * inverse_r <= tree.theta && one_image
+            && !in_box(curr_node, pos, box_length)){
+            double inverse_rs = 1/sqrt(r * r + eps2);
+            acc += d * (G * curr_node.com.mass * inverse_rs * inverse_rs
+                          * inverse_rs);
+            acc += quadrupole_acc(curr_node.quad, d, inverse_rs);
+            acc += curr_node.com.mass * ewald.acc(d);
+        }
+        else if (is_leaf(curr_node)){
+            for (size_t j = curr_node.begin; j < curr_node.end; ++j){
+                vec d_p = min_image(vec(tree.x[j], tree.y[j], tree.z[j])
+                                    - pos, box_length);
+                double r2 = dot(d_p, d_p);
+                if (r2 == 0.0){
+                    continue;
+                }
+                double inverse_r_p = 1/sqrt(r2 + eps2);
+                acc += d_p * (G * tree.mass[j] * inverse_r_p * inverse_r_p
+                                * inverse_r_p);
+                acc += tree.mass[j] * ewald.acc(d_p);
+            }
+        }
+        else{
+            for (int n = 7; n >= 0; --n){
+                if (curr_node.children[n] >= 0){
+                    stack[top++] = curr_node.children[n];
+                }
+            }
+        }
+    }
+
+    return acc;
+}
+
+// Force routine for the integrators, the box is the tree's root box.
+// Particles that drifted out are wrapped back in before the tree is built.
+force_fn periodic_force(linear_octree &tree, const ewald_table &ewald,
+                        size_t box_threshold){
+    return [&tree, &ewald, box_threshold](std::vector<particle> &p_vec,
+                                          const std::vector<size_t> &active){
+        wrap_positions(p_vec, tree.p, tree.box_length);
+        make_linear_octree(tree, p_vec, box_threshold);
+
+        #pragma omp parallel for schedule(dynamic, 64)
+        for (size_t a = 0; a < active.size(); ++a){
+            particle &part = p_vec[active[a]];
+            part.acc = periodic_walk(tree, ewald, part.p);
+        }
+    };
+}
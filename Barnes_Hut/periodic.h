@@ -0,0 +1,75 @@
+/*-------------periodic.h-----------------------------------------------------//
+*
+* Purpose: Header file for periodic.cpp, gravity in a periodic box with the
+*          Ewald sum, for representative volumes of a larger universe
+*
+*   Notes: The box is the linear octree's root, centered on tree.p. The walk
+*          uses the nearest image of every node and particle, and the rest
+*          of the infinite lattice is added from a table of the Ewald
+*          correction (periodic force minus nearest image force), made once
+*          at startup. As usual for Ewald, the mean density is taken out,
+*          so a uniform box feels no force.
+*
+*-----------------------------------------------------------------------------*/
+
+#ifndef PERIODIC_H
+#define PERIODIC_H
+
+#include "integrator.h"
+#include "linear_octree.h"
+
+/*----------------------------------------------------------------------------//
+* STRUCTS
+*-----------------------------------------------------------------------------*/
+
+// Points per side of the Ewald table, which covers one octant [0, L/2]^3
+const int EWALD_POINTS = 33;
+
+// Splitting between the real and k-space sums, in units of 1 / box length
+const double EWALD_ALPHA = 2.0;
+
+// Images / wave vectors from -EWALD_IMAGES to EWALD_IMAGES in each direction
+const int EWALD_IMAGES = 4;
+
+struct ewald_table {
+    double box_length;
+    int n;
+
+    // Correction at grid point (i, j, k) of the octant, per unit G * mass
+    std::vector<vec> corr;
+
+    ewald_table() : box_length(1.0), n(0) {}
+
+    // Correction to the acceleration towards a unit mass at offset d (the
+    // nearest image), trilinear in the table
+    vec acc(vec d) const;
+};
+
+// Fills the table for a box, this takes a moment so do it once
+void make_ewald_table(ewald_table &ewald, double box_length,
+                      int n = EWALD_POINTS);
+
+// Ewald correction evaluated directly, x is in units of the box
+vec ewald_correction(vec x);
+
+inline vec min_image(vec d, double box_length){
+    return vec(d.x - box_length * nearbyint(d.x / box_length),
+               d.y - box_length * nearbyint(d.y / box_length),
+               d.z - box_length * nearbyint(d.z / box_length));
+}
+
+// Moves every particle back into the box around center
+void wrap_positions(std::vector<particle> &p_vec, vec center,
+                    double box_length);
+
+// Acceleration at pos from the periodic tree, nodes that are not wholly
+// within half a box of pos in every direction are always opened
+vec periodic_walk(const linear_octree &tree, const ewald_table &ewald,
+                  vec pos);
+
+// Force routine for the integrators, the box is the tree's root box and
+// the table must be made for the same box length
+force_fn periodic_force(linear_octree &tree, const ewald_table &ewald,
+                        size_t box_threshold);
+
+#endif
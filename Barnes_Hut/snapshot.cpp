@@ -0,0 +1,499 @@
+/*-------------snapshot.cpp---------------------------------------------------//
+*
+* Purpose: Binary snapshots of the particles, written by a background thread
+*          and read back through a memory mapping
+*
+*   Notes: write() only converts the particles to float32 / float64 blocks,
+*          shuffling, compression and the disk are left to the thread
+*
+*-----------------------------------------------------------------------------*/
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "snapshot.h"
+
+/*----------------------------------------------------------------------------//
+* SUBROUTINES
+*-----------------------------------------------------------------------------*/
+
+static size_t type_size(snapshot_type type){
+    return type == snapshot_type::f32 ? sizeof(float) : sizeof(double);
+}
+
+static size_t padded(size_t bytes){
+    return (bytes + 7) & ~(size_t)7;
+}
+
+// Deflate never does better than this, so a block claiming more is damaged
+const size_t ZLIB_MAX_RATIO = 1032;
+
+// Byte shuffle, byte b of value i goes to b * n + i
+static void shuffle(const char *in, char *out, size_t n, size_t width){
+    for (size_t i = 0; i < n; ++i){
+        for (size_t b = 0; b < width; ++b){
+            out[b * n + i] = in[i * width + b];
+        }
+    }
+}
+
+static void unshuffle(const char *in, char *out, size_t n, size_t width){
+    for (size_t i = 0; i < n; ++i){
+        for (size_t b = 0; b < width; ++b){
+            out[i * width + b] = in[b * n + i];
+        }
+    }
+}
+
+snapshot_writer::snapshot_writer(const std::string &path,
+                                 snapshot_options opt)
+    : file(fopen(path.c_str(), "wb")), options(opt), next(0),
+      queued{false, false}, done(false), failed(false){
+
+    if (!file){
+        return;
+    }
+
+    file_header header;
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.frame_header_size = sizeof(frame_header);
+    header.block_header_size = sizeof(block_header);
+    header.reserved = 0;
+    failed = fwrite(&header, sizeof(header), 1, file) != 1;
+
+    thread = std::thread(&snapshot_writer::run, this);
+}
+
+snapshot_writer::~snapshot_writer(){
+    close();
+}
+
+// Writes out the queued frames and closes the file
+bool snapshot_writer::close(){
+    if (!file){
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        done = true;
+    }
+    cond.notify_all();
+    thread.join();
+
+    // The thread is gone, so failed is ours now
+    failed = fclose(file) != 0 || failed;
+    file = nullptr;
+    return !failed;
+}
+
+// Fills the next buffer with field(block, i) for every selected block and
+// hands it to the thread. Waits only if that buffer is still queued.
+template <typename F>
+void snapshot_writer::queue(size_t n, double time, size_t step,
+                            const F &field){
+    if (!file){
+        return;
+    }
+
+    int curr;
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        cond.wait(guard, [this]{ return !queued[next]; });
+        curr = next;
+    }
+
+    static const char *names[10] = {"x", "y", "z", "vx", "vy", "vz",
+                                    "ax", "ay", "az", "mass"};
+    static const uint32_t fields[10] = {SNAP_POS, SNAP_POS, SNAP_POS,
+                                        SNAP_VEL, SNAP_VEL, SNAP_VEL,
+                                        SNAP_ACC, SNAP_ACC, SNAP_ACC,
+                                        SNAP_MASS};
+
+    snapshot_buffer &buffer = buffers[curr];
+    buffer.block_headers.clear();
+    size_t width = type_size(options.type);
+
+    for (int b = 0; b < 10; ++b){
+        if (!(options.fields & fields[b])){
+            continue;
+        }
+
+        block_header block;
+        memset(&block, 0, sizeof(block));
+        memcpy(block.name, names[b], strlen(names[b]));
+        block.type = options.type;
+        block.compression = options.compression;
+        block.raw_size = n * width;
+
+        size_t slot = buffer.block_headers.size();
+        buffer.block_headers.push_back(block);
+        if (buffer.blocks.size() <= slot){
+            buffer.blocks.resize(slot + 1);
+        }
+
+        std::vector<char> &data = buffer.blocks[slot];
+        data.resize(block.raw_size);
+        if (options.type == snapshot_type::f32){
+            float *out = reinterpret_cast<float*>(data.data());
+            #pragma omp parallel for schedule(static)
+            for (size_t i = 0; i < n; ++i){
+                out[i] = (float)field(b, i);
+            }
+        }
+        else{
+            double *out = reinterpret_cast<double*>(data.data());
+            #pragma omp parallel for schedule(static)
+            for (size_t i = 0; i < n; ++i){
+                out[i] = field(b, i);
+            }
+        }
+    }
+
+    buffer.header.frame_size = 0;
+    buffer.header.n_particles = n;
+    buffer.header.step = step;
+    buffer.header.time = time;
+    buffer.header.n_blocks = buffer.block_headers.size();
+    buffer.header.reserved = 0;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        queued[curr] = true;
+        next = 1 - curr;
+    }
+    cond.notify_all();
+}
+
+void snapshot_writer::write(const std::vector<particle> &p_vec, double time,
+                            size_t step){
+    queue(p_vec.size(), time, step, [&p_vec](int b, size_t i){
+        const particle &part = p_vec[i];
+        switch (b){
+        case 0: return part.p.x;
+        case 1: return part.p.y;
+        case 2: return part.p.z;
+        case 3: return part.vel.x;
+        case 4: return part.vel.y;
+        case 5: return part.vel.z;
+        case 6: return part.acc.x;
+        case 7: return part.acc.y;
+        case 8: return part.acc.z;
+        default: return part.mass;
+        }
+    });
+}
+
+void snapshot_writer::write(const particle_soa &parts, double time,
+                            size_t step){
+    const double *arrays[10] = {parts.x.data(), parts.y.data(),
+                                parts.z.data(), parts.vx.data(),
+                                parts.vy.data(), parts.vz.data(),
+                                parts.ax.data(), parts.ay.data(),
+                                parts.az.data(), parts.mass.data()};
+    queue(parts.size(), time, step, [&arrays](int b, size_t i){
+        return arrays[b][i];
+    });
+}
+
+// Waits until every queued frame is on disk
+void snapshot_writer::flush(){
+    if (!file){
+        return;
+    }
+
+    std::unique_lock<std::mutex> guard(lock);
+    cond.wait(guard, [this]{ return !queued[0] && !queued[1]; });
+    fflush(file);
+}
+
+// Writer thread, takes the buffers in the order they were queued
+void snapshot_writer::run(){
+    int curr = 0;
+    while (true){
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            cond.wait(guard, [this, curr]{ return queued[curr] || done; });
+            if (!queued[curr]){
+                return;
+            }
+        }
+
+        write_frame(buffers[curr]);
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            queued[curr] = false;
+        }
+        cond.notify_all();
+        curr = 1 - curr;
+    }
+}
+
+// Compresses the blocks of a buffer if asked to and writes out the frame
+void snapshot_writer::write_frame(snapshot_buffer &buffer){
+    static const char zeros[8] = {0};
+
+    // Compressed blocks are kept in packed, one after the other
+    std::vector<size_t> offsets(buffer.block_headers.size());
+    buffer.packed.clear();
+
+    size_t frame_size = sizeof(frame_header);
+    for (size_t b = 0; b < buffer.block_headers.size(); ++b){
+        block_header &block = buffer.block_headers[b];
+        block.stored_size = block.raw_size;
+
+        if (block.compression == snapshot_compression::shuffle_zlib){
+            size_t width = type_size(block.type);
+            buffer.shuffled.resize(block.raw_size);
+            shuffle(buffer.blocks[b].data(), buffer.shuffled.data(),
+                    block.raw_size / width, width);
+
+            uLongf bound = compressBound(block.raw_size);
+            offsets[b] = buffer.packed.size();
+            buffer.packed.resize(offsets[b] + bound);
+            if (compress2((Bytef*)&buffer.packed[offsets[b]], &bound,
+                          (const Bytef*)buffer.shuffled.data(),
+                          block.raw_size, options.level) != Z_OK){
+                // Out of memory, say, the frame is dropped and close fails
+                failed = true;
+                return;
+            }
+            buffer.packed.resize(offsets[b] + bound);
+            block.stored_size = bound;
+        }
+
+        frame_size += sizeof(block_header) + padded(block.stored_size);
+    }
+
+    buffer.header.frame_size = frame_size;
+    bool ok = fwrite(&buffer.header, sizeof(frame_header), 1, file) == 1;
+
+    for (size_t b = 0; b < buffer.block_headers.size(); ++b){
+        const block_header &block = buffer.block_headers[b];
+        const char *data = block.compression == snapshot_compression::none
+                           ? buffer.blocks[b].data()
+                           : &buffer.packed[offsets[b]];
+        size_t padding = padded(block.stored_size) - block.stored_size;
+
+        ok = ok && fwrite(&block, sizeof(block_header), 1, file) == 1
+             && fwrite(data, 1, block.stored_size, file) == block.stored_size
+             && fwrite(zeros, 1, padding, file) == padding;
+    }
+
+    // Only this thread touches failed until close joins it
+    failed = failed || !ok;
+}
+
+// Block with the given name, or nullptr
+const block_header* snapshot_frame::find(const std::string &name) const{
+    for (auto block : blocks){
+        if (strncmp(block->name, name.c_str(), sizeof(block->name)) == 0){
+            return block;
+        }
+    }
+    return nullptr;
+}
+
+snapshot_reader::~snapshot_reader(){
+    close();
+}
+
+// Maps the file and walks the frame headers to find every block
+bool snapshot_reader::open(const std::string &path){
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0){
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(file_header)){
+        ::close(fd);
+        return false;
+    }
+
+    void *map = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED){
+        return false;
+    }
+    data = static_cast<const char*>(map);
+    size = info.st_size;
+
+    const file_header *header = reinterpret_cast<const file_header*>(data);
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0
+        || header->version > SNAPSHOT_VERSION
+        || header->frame_header_size < sizeof(frame_header)
+        || header->block_header_size < sizeof(block_header)){
+        close();
+        return false;
+    }
+
+    // Fields added after the ones known here are skipped over
+    frame_header_size = header->frame_header_size;
+    block_header_size = header->block_header_size;
+
+    size_t offset = sizeof(file_header);
+    while (offset + sizeof(frame_header) <= size){
+        snapshot_frame curr;
+        curr.header = reinterpret_cast<const frame_header*>(data + offset);
+        if (curr.header->frame_size < frame_header_size
+            || curr.header->frame_size > size - offset){
+            break;
+        }
+
+        // Sizes are checked against what is left of the frame before they
+        // are added, so garbage cannot wrap the offset around
+        size_t block_offset = offset + frame_header_size;
+        size_t frame_end = offset + curr.header->frame_size;
+        for (uint32_t b = 0; b < curr.header->n_blocks; ++b){
+            if (frame_end - block_offset < block_header_size){
+                break;
+            }
+            const block_header *block
+                = reinterpret_cast<const block_header*>(data + block_offset);
+            size_t left = frame_end - block_offset - block_header_size;
+            if (block->stored_size > left
+                || padded(block->stored_size) > left){
+                break;
+            }
+
+            // Every block holds one value per particle, and what it stores
+            // has to be able to unpack to that, so n_particles is bounded
+            // by the file size as well
+            size_t width = type_size(block->type);
+            if (block->raw_size % width != 0
+                || block->raw_size / width != curr.header->n_particles){
+                break;
+            }
+            if (block->compression == snapshot_compression::none
+                ? block->stored_size != block->raw_size
+                : block->compression != snapshot_compression::shuffle_zlib
+                  || block->raw_size / ZLIB_MAX_RATIO > block->stored_size){
+                break;
+            }
+            curr.blocks.push_back(block);
+            block_offset += block_header_size + padded(block->stored_size);
+        }
+        if (curr.blocks.size() != curr.header->n_blocks
+            || block_offset > frame_end){
+            break;
+        }
+
+        frames.push_back(curr);
+        offset = frame_end;
+    }
+
+    return true;
+}
+
+void snapshot_reader::close(){
+    if (data){
+        munmap(const_cast<char*>(data), size);
+    }
+    data = nullptr;
+    size = 0;
+    frame_header_size = 0;
+    block_header_size = 0;
+    frames.clear();
+}
+
+const void* snapshot_reader::block_data(const block_header *block) const{
+    return reinterpret_cast<const char*>(block) + block_header_size;
+}
+
+// Copies (and decompresses) a block into doubles, false if it is missing
+bool snapshot_reader::read(const snapshot_frame &curr,
+                           const std::string &name,
+                           std::vector<double> &out) const{
+    const block_header *block = curr.find(name);
+    if (!block){
+        return false;
+    }
+
+    // Sizes come from the file, nothing is allocated unless they agree
+    size_t width = type_size(block->type);
+    size_t n = block->raw_size / width;
+    if (block->raw_size % width != 0 || n != curr.header->n_particles){
+        return false;
+    }
+    const char *raw = static_cast<const char*>(block_data(block));
+
+    std::vector<char> unpacked;
+    if (block->compression == snapshot_compression::shuffle_zlib){
+        std::vector<char> shuffled(block->raw_size);
+        uLongf length = block->raw_size;
+        if (uncompress((Bytef*)shuffled.data(), &length, (const Bytef*)raw,
+                       block->stored_size) != Z_OK
+            || length != block->raw_size){
+            return false;
+        }
+        unpacked.resize(block->raw_size);
+        unshuffle(shuffled.data(), unpacked.data(), n, width);
+        raw = unpacked.data();
+    }
+    else if (block->compression != snapshot_compression::none
+             || block->stored_size != block->raw_size){
+        return false;
+    }
+
+    out.resize(n);
+    for (size_t i = 0; i < n; ++i){
+        if (block->type == snapshot_type::f32){
+            float value;
+            memcpy(&value, raw + i * width, width);
+            out[i] = value;
+        }
+        else{
+            memcpy(&out[i], raw + i * width, width);
+        }
+    }
+    return true;
+}
+
+// Reads a whole frame back into particles, missing fields are zero
+bool snapshot_reader::read(const snapshot_frame &curr,
+                           std::vector<particle> &p_vec) const{
+
+    // Only the blocks vouch for n_particles, see open
+    if (curr.blocks.empty()){
+        return false;
+    }
+    size_t n = curr.header->n_particles;
+    p_vec.assign(n, particle(vec(), vec(), vec(), 0.0));
+
+    auto fill = [&](const char *name, double particle::*member){
+        std::vector<double> values;
+        if (!read(curr, name, values) || values.size() != n){
+            return false;
+        }
+        for (size_t i = 0; i < n; ++i){
+            p_vec[i].*member = values[i];
+        }
+        return true;
+    };
+    auto fill_vec = [&](const char *x, const char *y, const char *z,
+                        vec particle::*member){
+        std::vector<double> vx, vy, vz;
+        if (!read(curr, x, vx) || !read(curr, y, vy) || !read(curr, z, vz)
+            || vx.size() != n || vy.size() != n || vz.size() != n){
+            return false;
+        }
+        for (size_t i = 0; i < n; ++i){
+            p_vec[i].*member = vec(vx[i], vy[i], vz[i]);
+        }
+        return true;
+    };
+
+    bool any = fill_vec("x", "y", "z", &particle::p);
+    any |= fill_vec("vx", "vy", "vz", &particle::vel);
+    any |= fill_vec("ax", "ay", "az", &particle::acc);
+    any |= fill("mass", &particle::mass);
+    return any;
+}
@@ -0,0 +1,219 @@
+/*-------------snapshot.h-----------------------------------------------------//
+*
+* Purpose: Header file for snapshot.cpp, a binary format for particle output
+*          with a writer thread, so the simulation does not wait on the disk
+*
+*   Notes: A file is a file_header followed by frames, one per write call.
+*          Every frame is a frame_header and then n_blocks blocks, each a
+*          block_header followed by its data, padded to 8 bytes. All values
+*          are little endian. Uncompressed blocks are plain float32 / float64
+*          arrays, so a mapped file can be read in place, e.g. with
+*          numpy.memmap at the offset of the block data.
+*
+*          Compressed blocks are byte shuffled (all first bytes of every
+*          value, then all second bytes...) before zlib, which groups the
+*          slowly changing exponent bytes together.
+*
+*-----------------------------------------------------------------------------*/
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "barnes_hut.h"
+#include "particle_soa.h"
+
+/*----------------------------------------------------------------------------//
+* STRUCTS
+*-----------------------------------------------------------------------------*/
+
+// "BHSNAP" and two zeros, then the version of the layout below
+const char SNAPSHOT_MAGIC[8] = {'B', 'H', 'S', 'N', 'A', 'P', 0, 0};
+const uint32_t SNAPSHOT_VERSION = 1;
+
+// Fields that can be written, one block each
+enum snapshot_field : uint32_t {
+    SNAP_POS = 1,
+    SNAP_VEL = 2,
+    SNAP_ACC = 4,
+    SNAP_MASS = 8
+};
+
+enum class snapshot_type : uint8_t {
+    f32 = 1,
+    f64 = 2
+};
+
+enum class snapshot_compression : uint8_t {
+    none = 0,
+    shuffle_zlib = 1
+};
+
+struct file_header {
+    char magic[8];
+    uint32_t version;
+
+    // Size of the headers below, so a newer reader can skip added fields
+    uint32_t frame_header_size, block_header_size;
+    uint32_t reserved;
+};
+
+struct frame_header {
+    // Size of the whole frame with this header, the offset to the next one
+    uint64_t frame_size;
+    uint64_t n_particles;
+    uint64_t step;
+    double time;
+    uint32_t n_blocks;
+    uint32_t reserved;
+};
+
+struct block_header {
+    // Name of the block, zero padded: x, y, z, vx, vy, vz, ax, ay, az, mass
+    char name[8];
+    snapshot_type type;
+    snapshot_compression compression;
+    uint8_t reserved[6];
+
+    // Size of the data before compression and as stored (without padding)
+    uint64_t raw_size, stored_size;
+};
+
+struct snapshot_options {
+    // Or of snapshot_field values
+    uint32_t fields;
+    snapshot_type type;
+    snapshot_compression compression;
+
+    // zlib level, 1 is fastest
+    int level;
+
+    snapshot_options() : fields(SNAP_POS | SNAP_VEL | SNAP_MASS),
+                         type(snapshot_type::f32),
+                         compression(snapshot_compression::none), level(1) {}
+};
+
+// Frame being filled by the simulation or written by the writer thread
+struct snapshot_buffer {
+    frame_header header;
+
+    // Headers and raw data of the blocks, stored sizes are set on write
+    std::vector<block_header> block_headers;
+    std::vector<std::vector<char>> blocks;
+
+    // Scratch space for shuffling and compression
+    std::vector<char> shuffled, packed;
+};
+
+// Writes frames from a background thread. There are two buffers: write()
+// fills one while the thread writes the other, and only waits if the
+// thread is still busy with the frame before last.
+struct snapshot_writer {
+    snapshot_writer(const std::string &path,
+                    snapshot_options opt = snapshot_options());
+
+    // Closes the file if close was not called
+    ~snapshot_writer();
+
+    snapshot_writer(const snapshot_writer&) = delete;
+    snapshot_writer& operator=(const snapshot_writer&) = delete;
+
+    bool is_open() const {
+        return file != nullptr;
+    }
+
+    // Copies the particles into a free buffer and queues it
+    void write(const std::vector<particle> &p_vec, double time, size_t step);
+    void write(const particle_soa &parts, double time, size_t step);
+
+    // Waits until every queued frame is on disk
+    void flush();
+
+    // Writes out the queued frames and closes the file. Returns false if
+    // any write failed (a full disk, say), the file is then incomplete.
+    bool close();
+
+    // Everything below is shared with the writer thread
+    template <typename F>
+    void queue(size_t n, double time, size_t step, const F &field);
+
+    void run();
+    void write_frame(snapshot_buffer &buffer);
+
+    FILE *file;
+    snapshot_options options;
+
+    snapshot_buffer buffers[2];
+
+    // Buffer filled by the next write, and whether each one waits on the
+    // thread. Both are guarded by lock.
+    int next;
+    bool queued[2];
+    bool done;
+
+    // Set when a write fails, by the thread after the header
+    bool failed;
+
+    std::mutex lock;
+    std::condition_variable cond;
+    std::thread thread;
+};
+
+// One frame of a mapped file
+struct snapshot_frame {
+    const frame_header *header;
+    std::vector<const block_header*> blocks;
+
+    // Block with the given name, or nullptr
+    const block_header* find(const std::string &name) const;
+};
+
+// Maps a snapshot file and finds its frames, the data is read in place
+struct snapshot_reader {
+    snapshot_reader() : data(nullptr), size(0), frame_header_size(0),
+                        block_header_size(0) {}
+    ~snapshot_reader();
+
+    snapshot_reader(const snapshot_reader&) = delete;
+    snapshot_reader& operator=(const snapshot_reader&) = delete;
+
+    // Returns false if the file cannot be mapped or is not a snapshot. A
+    // frame cut short (by a crash during a write) or with blocks that do
+    // not match its particle count ends the file.
+    bool open(const std::string &path);
+    void close();
+
+    size_t frame_count() const {
+        return frames.size();
+    }
+
+    const snapshot_frame& frame(size_t i) const {
+        return frames[i];
+    }
+
+    // Pointer to the data of a block, for uncompressed blocks it points
+    // into the mapping
+    const void* block_data(const block_header *block) const;
+
+    // Copies (and decompresses) a block into doubles, false if it is missing
+    bool read(const snapshot_frame &curr, const std::string &name,
+              std::vector<double> &out) const;
+
+    // Reads a whole frame back into particles, missing fields are zero
+    bool read(const snapshot_frame &curr, std::vector<particle> &p_vec) const;
+
+    const char *data;
+    size_t size;
+
+    // Header sizes of the file, at least the ones this reader knows
+    size_t frame_header_size, block_header_size;
+
+    std::vector<snapshot_frame> frames;
+};
+
+#endif
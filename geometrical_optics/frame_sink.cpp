@@ -0,0 +1,149 @@
+/*-------------frame_sink.cpp-------------------------------------------------//
+*
+* Purpose: Write finished animation frames on a background thread, from a
+*          small ring of surfaces
+*
+*-----------------------------------------------------------------------------*/
+
+#include <iomanip>
+#include <sstream>
+#include "frame_sink.h"
+
+// Function to write one frame, as a PNG or raw pixels into the pipe
+static bool write_frame(frame_sink &sink, cairo_surface_t *surface,
+                        int number){
+    if (!sink.pipe){
+        std::stringstream ss;
+        ss << sink.pngbase << std::setw(5) << std::setfill('0') << number
+           << ".png";
+        return cairo_surface_write_to_png(surface, ss.str().c_str())
+               == CAIRO_STATUS_SUCCESS;
+    }
+
+    // Rows can be padded, so they go one at a time
+    unsigned char *data = cairo_image_surface_get_data(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+    size_t row = (size_t)sink.res_x * 4;
+    for (int y = 0; y < sink.res_y; ++y){
+        if (fwrite(data + (size_t)y * stride, 1, row, sink.pipe) != row){
+            return false;
+        }
+    }
+    return true;
+}
+
+// Function the writer thread runs until the sink closes
+static void write_frames(frame_sink &sink){
+    std::unique_lock<std::mutex> guard(sink.lock);
+    while (true){
+        sink.changed.wait(guard, [&sink](){
+            return !sink.queued.empty() || sink.closing;
+        });
+        if (sink.queued.empty()){
+            return;
+        }
+
+        // Written without the lock, so drawing goes on meanwhile
+        int slot = sink.queued.front();
+        sink.queued.pop_front();
+        guard.unlock();
+        bool written = write_frame(sink, sink.ring[slot],
+                                   sink.ring_frame[slot]);
+        guard.lock();
+
+        sink.ok = sink.ok && written;
+        sink.free_slots.push_back(slot);
+        sink.changed.notify_all();
+    }
+}
+
+// Starts the writer
+bool open_sink(frame_sink &sink, int res_x, int res_y,
+               const std::string &pngbase, const std::string &command,
+               int ring_size){
+    sink.res_x = res_x;
+    sink.res_y = res_y;
+    sink.pngbase = pngbase;
+    sink.pipe = nullptr;
+    sink.closing = false;
+    sink.ok = true;
+
+    if (!command.empty()){
+        sink.old_sigpipe = signal(SIGPIPE, SIG_IGN);
+        sink.pipe = popen(command.c_str(), "w");
+        if (!sink.pipe){
+            signal(SIGPIPE, sink.old_sigpipe);
+            return false;
+        }
+    }
+
+    sink.ring.resize(ring_size);
+    sink.ring_frame.assign(ring_size, 0);
+    for (int i = 0; i < ring_size; ++i){
+        sink.ring[i] = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, res_x,
+                                                  res_y);
+        sink.free_slots.push_back(i);
+    }
+
+    sink.writer = std::thread(write_frames, std::ref(sink));
+    return true;
+}
+
+// Function to get a cleared surface to draw frame number into
+cairo_surface_t *sink_acquire(frame_sink &sink, int number){
+    int slot;
+    {
+        std::unique_lock<std::mutex> guard(sink.lock);
+        sink.changed.wait(guard, [&sink](){
+            return !sink.free_slots.empty();
+        });
+        slot = sink.free_slots.front();
+        sink.free_slots.pop_front();
+    }
+    sink.ring_frame[slot] = number;
+
+    cairo_t *ctx = cairo_create(sink.ring[slot]);
+    cairo_set_operator(ctx, CAIRO_OPERATOR_CLEAR);
+    cairo_paint(ctx);
+    cairo_destroy(ctx);
+
+    return sink.ring[slot];
+}
+
+// Function to hand a surface of sink_acquire to the writer
+void sink_submit(frame_sink &sink, cairo_surface_t *surface){
+    cairo_surface_flush(surface);
+
+    std::lock_guard<std::mutex> guard(sink.lock);
+    for (size_t slot = 0; slot < sink.ring.size(); ++slot){
+        if (sink.ring[slot] == surface){
+            sink.queued.push_back(slot);
+        }
+    }
+    sink.changed.notify_all();
+}
+
+// Writes out everything queued and stops the writer
+bool close_sink(frame_sink &sink){
+    {
+        std::lock_guard<std::mutex> guard(sink.lock);
+        sink.closing = true;
+        sink.changed.notify_all();
+    }
+    if (sink.writer.joinable()){
+        sink.writer.join();
+    }
+
+    for (auto surface : sink.ring){
+        cairo_surface_destroy(surface);
+    }
+    sink.ring.clear();
+    sink.free_slots.clear();
+
+    if (sink.pipe){
+        sink.ok = pclose(sink.pipe) == 0 && sink.ok;
+        sink.pipe = nullptr;
+        signal(SIGPIPE, sink.old_sigpipe);
+    }
+    return sink.ok;
+}
@@ -0,0 +1,74 @@
+/*------------frame_sink.h----------------------------------------------------//
+*
+* Purpose: Header file for frame_sink.cpp, writes finished frames in the
+*          background while the next ones are drawn
+*
+*   Notes: Frames are drawn into a small ring of image surfaces, so memory
+*          does not grow with the length of the animation. A writer thread
+*          saves each one as a PNG, or pipes its raw pixels (BGRA, 8 bits
+*          each, rows of res_x pixels) into a command such as
+*              ffmpeg -f rawvideo -pixel_format bgra -video_size 600x450
+*                     -framerate 10 -i - animation.mp4
+*
+*-----------------------------------------------------------------------------*/
+
+#ifndef FRAME_SINK_H
+#define FRAME_SINK_H
+
+#include <cairo.h>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Surfaces in the ring by default, enough to keep the writer busy
+const int SINK_RING = 4;
+
+struct frame_sink{
+    int res_x, res_y;
+
+    // PNGs are named pngbase + 5 digit frame number + ".png"
+    std::string pngbase;
+
+    // Raw frames go here instead when a command was given. SIGPIPE is
+    // ignored while it is open, so an encoder that quits early fails the
+    // writes instead of killing us, and is put back by close_sink.
+    FILE *pipe;
+    void (*old_sigpipe)(int);
+
+    // Ring of surfaces, with the frame number each one holds
+    std::vector<cairo_surface_t*> ring;
+    std::vector<int> ring_frame;
+
+    // Slots free to draw in, and slots waiting for the writer
+    std::deque<int> free_slots, queued;
+
+    std::mutex lock;
+    std::condition_variable changed;
+    std::thread writer;
+    bool closing;
+    bool ok;
+};
+
+// Starts the writer, PNGs if command is empty, otherwise a pipe into it
+// Returns false if the command could not be started
+bool open_sink(frame_sink &sink, int res_x, int res_y,
+               const std::string &pngbase, const std::string &command = "",
+               int ring_size = SINK_RING);
+
+// Function to get a cleared surface to draw frame number into, waits for
+// the writer when the whole ring is queued
+cairo_surface_t *sink_acquire(frame_sink &sink, int number);
+
+// Function to hand a surface of sink_acquire to the writer
+void sink_submit(frame_sink &sink, cairo_surface_t *surface);
+
+// Writes out everything queued and stops the writer
+// Returns false if any frame failed to write
+bool close_sink(frame_sink &sink);
+
+#endif
@@ -24,13 +24,14 @@
 * MAIN
 *-----------------------------------------------------------------------------*/
 
-int main() {
+int main(int argc, char **argv) {
 
-    // Creating layers for drawing
+    // Creating layers for drawing, only the drawing commands are kept and
+    // frames are made when they are written
     std::vector<frame> layer(3);
     for (size_t i = 0; i < layer.size(); ++i){
         layer[i].create_frame(600, 450, 10, "/tmp/image");
-        layer[i].init();
+        layer[i].init(true);
 
         layer[i].curr_frame = 1;
     }
@@ -55,6 +56,22 @@ int main() {
     auto lens = make_sphere(lens_p, radius, 1, erf_damped_sinusoid_index());
     ray_array rays = light_gen(dim, lens, max_vel, 0 /*0.523598776*/,
                                (layer[0].res_y / 2.0) - radius);
+    // Writes PNGs, or pipes raw frames into the command given, e.g.
+    //     ./geometrical "ffmpeg -y -f rawvideo -pixel_format bgra
+    //         -video_size 600x450 -framerate 10 -i - animation.mp4"
+    frame_sink sink;
+    if (!open_sink(sink, layer[0].res_x, layer[0].res_y, layer[0].pngbase,
+                   argc > 1 ? argv[1] : "")){
+        std::cout << "could not start " << argv[1] << '\n';
+        return 1;
+    }
+
+    // propagate_mod draws every frame of layer 1 once, in order, and the
+    // other layers are done by then, so each frame is written as soon as
+    // the simulation moves past it
+    frame_stream stream = {&layer, &sink, 0};
+    layer[1].stream = &stream;
+
     //draw_lens(layer, 1, lens);
     //propagate(std::begin(rays), std::end(rays), lens, 0.0001, 
     //          max_vel, layer[1], 1.0 / layer[1].fps);
@@ -64,7 +81,15 @@ int main() {
 
     //draw_function(layer[1], lens, 1, 2, 0.8);
 
-    draw_layers(layer);
+    stream_layers(layer, sink, stream.next);
+    if (!close_sink(sink)){
+        std::cout << "could not write all frames" << '\n';
+        return 1;
+    }
+
+    for (size_t i = 0; i < layer.size(); ++i){
+        layer[i].destroy_all();
+    }
 
 }
 
@@ -322,11 +347,12 @@ void propagate_mod(ray_array& rays, T& lens, double step_size,
                   step_size, max_vel, anim, 0);
         print_index(anim, lens.index_param, white);
         anim.curr_frame += 1;
+        release_frames(anim);
     
     }
 
     // Setting the final image to the rest of the animation
-    for (int i = anim.curr_frame; i <= num_frames; ++i){
+    for (int i = anim.curr_frame; i < num_frames; ++i){
         cairo_arc(anim.frame_ctx[i], lens.origin.x, lens.origin.y, lens.radius,
                   0, 2*M_PI);
         cairo_stroke(anim.frame_ctx[i]);
@@ -336,6 +362,7 @@ void propagate_mod(ray_array& rays, T& lens, double step_size,
                   step_size, max_vel, anim, 0);
         print_index(anim, lens.index_param, white);
         anim.curr_frame += 1;
+        release_frames(anim);
     }
 
 }
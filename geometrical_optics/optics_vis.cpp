@@ -12,11 +12,21 @@
 #include "geometrical.h"
 
 // Function to initialize the frame struct
-void frame::init(){
+void frame::init(bool record){
     int line_width = 1;
+    recording = record;
+    stream = nullptr;
+    cairo_rectangle_t extents = {0, 0, (double)res_x, (double)res_y};
     for (size_t i = 0; i < num_frames; ++i){
-        frame_surface[i] = 
-            cairo_image_surface_create(CAIRO_FORMAT_ARGB32, res_x, res_y);
+        if (recording){
+            frame_surface[i] = 
+                cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA,
+                                               &extents);
+        }
+        else{
+            frame_surface[i] = 
+                cairo_image_surface_create(CAIRO_FORMAT_ARGB32, res_x, res_y);
+        }
         frame_ctx[i] = cairo_create(frame_surface[i]);
         //cairo_set_line_cap(frame_ctx[i], CAIRO_LINE_CAP_ROUND);
         cairo_set_line_width(frame_ctx[i], line_width);
@@ -193,6 +203,66 @@ void draw_layers(std::vector<frame> &layer){
 
 }
 
+// Function to paint one frame of a layer onto ctx and free it
+static void paint_and_free(cairo_t *ctx, frame &anim, int i){
+    cairo_destroy(anim.frame_ctx[i]);
+    anim.frame_ctx[i] = nullptr;
+
+    cairo_set_source_surface(ctx, anim.frame_surface[i], 0, 0);
+    cairo_paint(ctx);
+
+    cairo_surface_destroy(anim.frame_surface[i]);
+    anim.frame_surface[i] = nullptr;
+}
+
+// Function to composite recording layers into the sink
+void stream_layers(std::vector<frame> &layer, frame_sink &sink,
+                   int first, int last){
+    for (int i = first; i < last; ++i){
+        cairo_surface_t *out = sink_acquire(sink, i);
+        cairo_t *ctx = cairo_create(out);
+
+        // Same order as draw_layers, which paints onto layer 0
+        paint_and_free(ctx, layer[0], i);
+        for (size_t j = layer.size() - 1; j > 0; --j){
+            paint_and_free(ctx, layer[j], i);
+        }
+
+        cairo_destroy(ctx);
+        sink_submit(sink, out);
+    }
+}
+
+// Function to write and free the frames anim has moved past
+void release_frames(frame &anim){
+    if (!anim.stream){
+        return;
+    }
+
+    int last = std::min(anim.curr_frame, num_frames);
+    if (last > anim.stream->next){
+        stream_layers(*anim.stream->layer, *anim.stream->sink,
+                      anim.stream->next, last);
+        anim.stream->next = last;
+    }
+}
+
+// Function to destroy all contexts and surfaces
+void frame::destroy_all(){
+    for (size_t i = 0; i < num_frames; ++i){
+        if (frame_ctx[i]){
+            cairo_destroy(frame_ctx[i]);
+            frame_ctx[i] = nullptr;
+        }
+        if (frame_surface[i]){
+            cairo_surface_destroy(frame_surface[i]);
+            frame_surface[i] = nullptr;
+        }
+    }
+    cairo_destroy(bg_ctx);
+    cairo_surface_destroy(bg_surface);
+}
+
 // Function to draw an animated circle
 void animate_circle(frame &anim, double time, double radius, vec ori, 
                     color &clr){
@@ -9,6 +9,7 @@
 #ifndef OPTICS_VIS_H
 #define OPTICS_VIS_H
 
+#include <algorithm>
 #include <cairo.h>
 #include <iostream>
 #include <iomanip>
@@ -16,11 +17,13 @@
 #include <string>
 #include <sstream>
 #include <vector>
+#include "frame_sink.h"
 
 //#define num_frames 300
 #define num_frames 300
 
 template<typename> struct sphere;
+struct frame_stream;
 
 // A very simple vector type with operators that are used in this file
 struct vec {
@@ -48,11 +51,19 @@ struct frame{
     vec origin;
     std::string pngbase;
 
+    // Frames hold drawing commands instead of pixels, see stream_layers
+    bool recording;
+
+    // Set on the layer drawn last when frames are written as they are done,
+    // see release_frames
+    frame_stream *stream;
+
     // Function to call frame struct
     void create_frame(int x, int y, int ps, std::string pngname);
 
-    // Function to initialize the frame struct
-    void init();
+    // Function to initialize the frame struct, with recording surfaces for
+    // the frames if record is set
+    void init(bool record = false);
 
     // Function to draw all frames in the frame struct
     void draw_frames();
@@ -76,6 +87,25 @@ void animate_line(frame &anim, int start_frame, double time,
 // Function to draw layers
 void draw_layers(std::vector<frame> &layer);
 
+// Function to composite frames first to last - 1 of recording layers into
+// the sink, as draw_layers does, freeing them as they go
+void stream_layers(std::vector<frame> &layer, frame_sink &sink,
+                   int first = 0, int last = num_frames);
+
+// Recording layers whose frames are written while they are still drawn
+struct frame_stream{
+    std::vector<frame> *layer;
+    frame_sink *sink;
+
+    // Frames before this one are written and freed
+    int next;
+};
+
+// Function to write and free all frames before anim.curr_frame when anim
+// has a stream. Every other layer has to be done with them by then, and
+// nothing may draw into them afterwards.
+void release_frames(frame &anim);
+
 // Function to draw an animated circle
 void animate_circle(frame &anim, double time, double radius, vec ori, 
                     color &clr);
@@ -150,6 +180,10 @@ void draw_lens(std::vector<frame> &layer, double time, const sphere<T> &lens){
         }
     }
 
+    // Recording frames copy the texture when it is finished
+    cairo_surface_finish(image);
+    cairo_surface_destroy(image);
+
     for (size_t i = 0; i < layer.size(); ++i){
         layer[i].curr_frame += time * layer[i].fps;
     }
@@ -183,6 +217,10 @@ void draw_lens_for_frame(frame &anim, const sphere<T> &lens){
     // Finding number of frames available
     index_plot(anim, anim.curr_frame, image, lens, lens_clr);
 
+    // Recording frames copy the texture when it is finished
+    cairo_surface_finish(image);
+    cairo_surface_destroy(image);
+
 }
 
 // function to create vector<double> for index_plot function
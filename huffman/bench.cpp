@@ -0,0 +1,306 @@
+/*-------------bench.cpp------------------------------------------------------//
+*
+* Purpose: Benchmark for the huffman coders. Times encoding, decoding and
+*          building the code table, and checks every round trip, for the
+*          static, per block, adaptive and block parallel coders
+*
+*   Notes: build with make bench, run with
+*              ./bench [MB per input] [files...]
+*          Generated inputs (zipf and uniform bytes, and the raw doubles of
+*          a smooth field, like a simulation dump) are 16 MB by default,
+*          files are added as they are. One line per input and coder,
+*          columns as in the header. Exits with 1 if a round trip fails.
+*
+*-----------------------------------------------------------------------------*/
+
+#include<chrono>
+#include<cmath>
+#include<cstdio>
+#include<cstdlib>
+#include<cstring>
+#include<random>
+#include "huffman_parallel.h"
+#include "vitter.h"
+
+/*----------------------------------------------------------------------------//
+* STRUCTS
+*-----------------------------------------------------------------------------*/
+
+// Runs are repeated until they take this long, so small inputs time well
+const double MIN_BENCH_TIME = 0.2;
+
+// Bytes per block for the per block and parallel coders
+const size_t BENCH_BLOCK = 1 << 16;
+
+struct bench_input{
+    std::string name;
+    std::string data;
+};
+
+struct bench_result{
+    // Compressed over original size
+    double ratio;
+
+    // Seconds per encode and per decode of the whole input
+    double encode, decode;
+
+    // Seconds per table (code lengths, codes and decoding table), 0 when
+    // the coder has none
+    double table;
+
+    bool ok;
+};
+
+/*----------------------------------------------------------------------------//
+* SUBROUTINES
+*-----------------------------------------------------------------------------*/
+
+static double seconds_since(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                         - start).count();
+}
+
+// Function to time f, repeated for at least MIN_BENCH_TIME
+template <typename F>
+static double time_it(F f){
+    size_t reps = 0;
+    auto start = std::chrono::steady_clock::now();
+    do {
+        f();
+        ++reps;
+    } while (seconds_since(start) < MIN_BENCH_TIME);
+    return seconds_since(start) / reps;
+}
+
+// Bytes drawn with probability falling as 1 / rank^s
+static std::string zipf_bytes(size_t size, double s, std::mt19937 &gen){
+    std::vector<double> weights(BYTE_ALPHABET);
+    for (size_t i = 0; i < weights.size(); ++i){
+        weights[i] = 1.0 / pow(i + 1.0, s);
+    }
+    std::discrete_distribution<int> dist(weights.begin(), weights.end());
+
+    std::string data(size, 0);
+    for (auto &c : data){
+        c = dist(gen);
+    }
+    return data;
+}
+
+static std::string uniform_bytes(size_t size, std::mt19937 &gen){
+    std::uniform_int_distribution<int> dist(0, 255);
+    std::string data(size, 0);
+    for (auto &c : data){
+        c = dist(gen);
+    }
+    return data;
+}
+
+// Raw doubles of a smooth field with a little noise, as dumps look
+static std::string field_bytes(size_t size, std::mt19937 &gen){
+    std::normal_distribution<double> noise(0.0, 1e-3);
+    std::vector<double> field(size / sizeof(double));
+    for (size_t i = 0; i < field.size(); ++i){
+        double x = i * 1e-4;
+        field[i] = sin(x) * exp(-0.01 * x) + noise(gen);
+    }
+
+    std::string data(size, 0);
+    memcpy(&data[0], field.data(), field.size() * sizeof(double));
+    return data;
+}
+
+static bool read_file(const char *path, std::string &data){
+    FILE *file = fopen(path, "rb");
+    if (!file){
+        return false;
+    }
+
+    char buffer[1 << 16];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0){
+        data.append(buffer, size);
+    }
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+// Time to make the table of one block, from its histogram on
+static double table_time(const char *data, size_t size){
+    std::vector<uint64_t> weights(BYTE_ALPHABET, 0);
+    add_histogram(data, size, weights);
+
+    node_pool pool;
+    std::vector<int> lengths;
+    std::vector<huffman_code> codes;
+    decode_table table;
+    return time_it([&](){
+        code_lengths(weights, LENGTH_LIMIT, lengths, pool);
+        canonical_codes(lengths, codes);
+        make_decode_table(table, codes);
+    });
+}
+
+// One code for all of the input
+static bench_result run_static(const std::string &data){
+    bench_result result;
+    std::vector<uint8_t> blob;
+    std::string decoded;
+
+    result.encode = time_it([&](){ blob = huffman_compress(data); });
+    result.decode = time_it([&](){
+        decoded.clear();
+        result.ok = huffman_decompress(blob.data(), blob.size(), decoded);
+    });
+    result.ok = result.ok && decoded == data;
+    result.ratio = (double)blob.size() / data.size();
+    result.table = table_time(data.data(), data.size());
+
+    return result;
+}
+
+// A new code for every block, as huffman_file -b does
+static bench_result run_per_block(const std::string &data){
+    bench_result result;
+    size_t num_blocks = (data.size() + BENCH_BLOCK - 1) / BENCH_BLOCK;
+    std::vector<bitstream> packed(num_blocks);
+    std::vector<std::vector<int>> lengths(num_blocks);
+    std::string decoded(data.size(), 0);
+
+    std::vector<uint64_t> weights(BYTE_ALPHABET);
+    std::vector<huffman_code> codes;
+    node_pool pool;
+    result.encode = time_it([&](){
+        for (size_t b = 0; b < num_blocks; ++b){
+            size_t first = b * BENCH_BLOCK;
+            size_t size = std::min(BENCH_BLOCK, data.size() - first);
+            std::fill(weights.begin(), weights.end(), 0);
+            add_histogram(data.data() + first, size, weights);
+            code_lengths(weights, LENGTH_LIMIT, lengths[b], pool);
+            canonical_codes(lengths[b], codes);
+            encode(codes, data.data() + first, size, packed[b]);
+        }
+    });
+
+    decode_table table;
+    result.decode = time_it([&](){
+        result.ok = true;
+        for (size_t b = 0; b < num_blocks; ++b){
+            size_t first = b * BENCH_BLOCK;
+            size_t size = std::min(BENCH_BLOCK, data.size() - first);
+            canonical_codes(lengths[b], codes);
+            make_decode_table(table, codes);
+            result.ok = table_decode(table, packed[b].words.data(),
+                                     packed[b].words.size(),
+                                     packed[b].bit_length,
+                                     &decoded[first], size) && result.ok;
+        }
+    });
+    result.ok = result.ok && decoded == data;
+
+    // Tables as the length nibbles huffman_file would write
+    size_t bytes = 0;
+    for (size_t b = 0; b < num_blocks; ++b){
+        std::vector<uint8_t> table_bytes;
+        write_lengths(lengths[b], table_bytes);
+        bytes += table_bytes.size() + packed[b].words.size() * 8;
+    }
+    result.ratio = (double)bytes / data.size();
+    result.table = table_time(data.data(),
+                              std::min(BENCH_BLOCK, data.size()));
+
+    return result;
+}
+
+// One pass adaptive coding, no table
+static bench_result run_adaptive(const std::string &data){
+    bench_result result;
+    bitstream packed;
+    std::string decoded(data.size(), 0);
+
+    result.encode = time_it([&](){
+        adaptive_tree tree;
+        adaptive_encode(tree, data.data(), data.size(), packed);
+    });
+    result.decode = time_it([&](){
+        adaptive_tree tree;
+        result.ok = adaptive_decode(tree, packed.words.data(),
+                                    packed.words.size(), packed.bit_length,
+                                    &decoded[0], decoded.size());
+    });
+    result.ok = result.ok && decoded == data;
+    result.ratio = (double)(packed.words.size() * 8) / data.size();
+    result.table = 0;
+
+    return result;
+}
+
+// Blocks coded on all cores with one code
+static bench_result run_parallel(const std::string &data){
+    bench_result result;
+    std::vector<uint8_t> blob;
+    std::string decoded;
+
+    result.encode = time_it([&](){
+        blob = parallel_compress(data.data(), data.size(), BENCH_BLOCK);
+    });
+    result.decode = time_it([&](){
+        decoded.clear();
+        result.ok = parallel_decompress(blob.data(), blob.size(), decoded);
+    });
+    result.ok = result.ok && decoded == data;
+    result.ratio = (double)blob.size() / data.size();
+    result.table = table_time(data.data(), data.size());
+
+    return result;
+}
+
+/*----------------------------------------------------------------------------//
+* MAIN
+*-----------------------------------------------------------------------------*/
+
+int main(int argc, char **argv){
+    double megabytes = argc > 1 ? atof(argv[1]) : 16;
+    size_t size = std::max((size_t)(megabytes * (1 << 20)), (size_t)8);
+
+    std::mt19937 gen(1);
+    std::vector<bench_input> inputs;
+    inputs.push_back(bench_input{"zipf", zipf_bytes(size, 1.1, gen)});
+    inputs.push_back(bench_input{"uniform", uniform_bytes(size, gen)});
+    inputs.push_back(bench_input{"field", field_bytes(size, gen)});
+    for (int i = 2; i < argc; ++i){
+        const char *slash = strrchr(argv[i], '/');
+        bench_input input{slash ? slash + 1 : argv[i], ""};
+        if (!read_file(argv[i], input.data)){
+            fprintf(stderr, "could not read %s\n", argv[i]);
+            return 1;
+        }
+        inputs.push_back(input);
+    }
+
+    const char *names[4] = {"static", "block", "adaptive", "parallel"};
+    bench_result (*coders[4])(const std::string&) = {run_static,
+                                                     run_per_block,
+                                                     run_adaptive,
+                                                     run_parallel};
+
+    printf("# %-10s %-9s %9s %7s %10s %10s %10s %3s\n", "input", "coder",
+           "MB", "ratio", "enc_MB/s", "dec_MB/s", "table_us", "ok");
+
+    bool all_ok = true;
+    for (auto &input : inputs){
+        double mb = input.data.size() / 1e6;
+        for (int c = 0; c < 4; ++c){
+            bench_result result = coders[c](input.data);
+            printf("  %-10s %-9s %9.3f %7.4f %10.1f %10.1f %10.2f %3d\n",
+                   input.name.c_str(), names[c], mb, result.ratio,
+                   mb / result.encode, mb / result.decode,
+                   result.table * 1e6, result.ok);
+            fflush(stdout);
+            all_ok = all_ok && result.ok;
+        }
+    }
+
+    return all_ok ? 0 : 1;
+}
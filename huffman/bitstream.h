@@ -0,0 +1,142 @@
+/*-------------bitstream.h----------------------------------------------------//
+*
+* Purpose: Packed bits for the huffman codes, 64 to a word instead of one
+*          char per bit
+*
+*   Notes: Bits go in most significant first, so the first bit of the
+*          stream is the top bit of words[0]. Codes read the same way, with
+*          their first bit as the highest of their length bits.
+*
+*-----------------------------------------------------------------------------*/
+
+#ifndef BITSTREAM_H
+#define BITSTREAM_H
+
+#include<cstdint>
+#include<string>
+#include<vector>
+
+// Struct to hold packed bits and the exact number of them
+struct bitstream{
+    std::vector<uint64_t> words;
+    size_t bit_length;
+
+    bitstream() : bit_length(0) {}
+};
+
+// Struct to read a bitstream, peeking at up to 32 bits at a time
+// The next bits sit left aligned in window, filled 32 at a time from words
+struct bit_reader{
+    const uint64_t *words;
+    size_t num_words;
+
+    uint64_t window;
+    int available;
+
+    // Next bit of words to go into window
+    size_t fetched;
+
+    bit_reader(const uint64_t *w, size_t n)
+        : words(w), num_words(n), window(0), available(0), fetched(0) {
+        refill();
+    }
+
+    bit_reader(const bitstream &stream)
+        : bit_reader(stream.words.data(), stream.words.size()) {}
+
+    // Bits used up so far
+    size_t position() const {
+        return fetched - available;
+    }
+
+    // Tops window up to more than 32 bits, past the end reads as zeros
+    void refill(){
+        while (available <= 32){
+            size_t i = fetched >> 6;
+            uint64_t half = i < num_words
+                            ? (words[i] >> (32 - (fetched & 32))) & 0xffffffff
+                            : 0;
+            window |= half << (32 - available);
+            available += 32;
+            fetched += 32;
+        }
+    }
+
+    // The next n bits (1 to 32) as an integer, without using them up
+    uint32_t peek(int n) const {
+        return window >> (64 - n);
+    }
+
+    // Uses up n bits (up to 32)
+    void skip(int n){
+        window <<= n;
+        available -= n;
+        if (available <= 32){
+            refill();
+        }
+    }
+};
+
+// Struct to append codes to a bitstream, a word at a time
+// Bits wait left aligned in buffer until it holds a full word
+struct bit_writer{
+    bitstream &stream;
+    uint64_t buffer;
+    int used;
+
+    bit_writer(bitstream &out) : stream(out), buffer(0), used(0) {}
+
+    // Appends the low length bits of bits (length 1 to 32)
+    void put(uint32_t bits, int length){
+        uint64_t code = (uint64_t)bits << (64 - length);
+        buffer |= code >> used;
+        used += length;
+        stream.bit_length += length;
+
+        if (used >= 64){
+            stream.words.push_back(buffer);
+            used -= 64;
+
+            // Whatever did not fit, shifting by 64 is undefined
+            buffer = used > 0 ? code << (length - used) : 0;
+        }
+    }
+
+    // Writes out the last partial word, call once at the end
+    void finish(){
+        if (used > 0){
+            stream.words.push_back(buffer);
+            buffer = 0;
+            used = 0;
+        }
+    }
+};
+
+// Function to pack a string of '0' and '1' characters
+inline bitstream pack_bits(const std::string &bits){
+    bitstream stream;
+    stream.bit_length = bits.size();
+    stream.words.assign((bits.size() + 63) / 64, 0);
+
+    for (size_t i = 0; i < bits.size(); ++i){
+        if (bits[i] == '1'){
+            stream.words[i >> 6] |= (uint64_t)1 << (63 - (i & 63));
+        }
+    }
+
+    return stream;
+}
+
+// Function to turn packed bits back into '0' and '1', for printing
+inline std::string bit_string(const bitstream &stream){
+    std::string bits(stream.bit_length, '0');
+    for (size_t i = 0; i < stream.bit_length; ++i){
+        if ((stream.words[i >> 6] >> (63 - (i & 63))) & 1){
+            bits[i] = '1';
+        }
+    }
+
+    return bits;
+}
+
+#endif
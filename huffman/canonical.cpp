@@ -0,0 +1,390 @@
+/*-------------canonical.cpp--------------------------------------------------//
+*
+* Purpose: Canonical huffman codes from length limited code lengths, and a
+*          compact header so encoded blobs carry their own code
+*
+*-----------------------------------------------------------------------------*/
+
+#include<algorithm>
+#include<cstring>
+#include "canonical.h"
+
+const char BLOB_MAGIC[4] = {'H', 'U', 'F', '1'};
+
+// Item of a package-merge list: a symbol, or a package of two items
+// (first and first + 1) of the list one level deeper
+struct pm_item{
+    uint64_t weight;
+    int leaf;
+    size_t first;
+};
+
+// Adds the count of every byte of data to weights (256 entries)
+void add_histogram(const char *data, size_t size,
+                   std::vector<uint64_t> &weights){
+    for (size_t i = 0; i < size; ++i){
+        ++weights[(unsigned char)data[i]];
+    }
+}
+
+// Same for 16 bit symbols (65536 entries)
+void add_histogram(const uint16_t *data, size_t size,
+                   std::vector<uint64_t> &weights){
+    for (size_t i = 0; i < size; ++i){
+        ++weights[data[i]];
+    }
+}
+
+// Package-merge, for when the plain huffman code is too long
+static bool package_merge(const std::vector<uint64_t> &weights, int limit,
+                          std::vector<int> &lengths){
+
+    lengths.assign(weights.size(), 0);
+    std::vector<int> leaves;
+    for (size_t i = 0; i < weights.size(); ++i){
+        if (weights[i] > 0){
+            leaves.push_back(i);
+        }
+    }
+    std::stable_sort(leaves.begin(), leaves.end(), [&weights](int a, int b)
+                         {return weights[a] < weights[b];});
+
+    size_t n = leaves.size();
+    if (n <= 1){
+        if (n == 1){
+            lengths[leaves[0]] = 1;
+        }
+        return true;
+    }
+    if ((uint64_t)n > ((uint64_t)1 << limit)){
+        return false;
+    }
+
+    // Deepest level first, every list holds the leaves merged with packages
+    // of the list before it. Only the 2n - 2 lightest items are ever used.
+    size_t keep = 2 * n - 2;
+    std::vector<std::vector<pm_item>> levels(limit);
+    for (int leaf : leaves){
+        levels[0].push_back(pm_item{weights[leaf], leaf, 0});
+    }
+
+    for (int l = 1; l < limit; ++l){
+        const std::vector<pm_item> &prev = levels[l - 1];
+        std::vector<pm_item> &curr = levels[l];
+        size_t num_packages = prev.size() / 2;
+        size_t i = 0, p = 0;
+
+        while (curr.size() < keep && (i < n || p < num_packages)){
+            uint64_t package_weight = p < num_packages
+                ? prev[2 * p].weight + prev[2 * p + 1].weight : 0;
+            if (p >= num_packages
+                || (i < n && weights[leaves[i]] <= package_weight)){
+                curr.push_back(pm_item{weights[leaves[i]], leaves[i], 0});
+                ++i;
+            }
+            else{
+                curr.push_back(pm_item{package_weight, -1, 2 * p});
+                ++p;
+            }
+        }
+    }
+
+    // Every time a leaf shows up in the chosen items its code gets longer
+    std::vector<std::pair<int, size_t>> stack;
+    for (size_t k = 0; k < keep; ++k){
+        stack.emplace_back(limit - 1, k);
+    }
+    while (!stack.empty()){
+        std::pair<int, size_t> top = stack.back();
+        stack.pop_back();
+
+        const pm_item &item = levels[top.first][top.second];
+        if (item.leaf >= 0){
+            ++lengths[item.leaf];
+        }
+        else{
+            stack.emplace_back(top.first - 1, item.first);
+            stack.emplace_back(top.first - 1, item.first + 1);
+        }
+    }
+
+    return true;
+}
+
+// Finds the best code lengths no longer than limit for the weights
+bool code_lengths(const std::vector<uint64_t> &weights, int limit,
+                  std::vector<int> &lengths){
+    node_pool pool;
+    return code_lengths(weights, limit, lengths, pool);
+}
+
+// Same, building the tree in pool, which keeps its memory for next time
+bool code_lengths(const std::vector<uint64_t> &weights, int limit,
+                  std::vector<int> &lengths, node_pool &pool){
+    if (limit < 1 || limit > MAX_CODE_LENGTH){
+        lengths.assign(weights.size(), 0);
+        return false;
+    }
+
+    // The plain huffman code is the best there is, if it fits the limit
+    build_tree(weights, pool);
+    if (tree_lengths(pool, weights.size(), lengths) <= limit){
+        return true;
+    }
+    return package_merge(weights, limit, lengths);
+}
+
+// Assigns canonical codes
+void canonical_codes(const std::vector<int> &lengths,
+                     std::vector<huffman_code> &codes){
+
+    codes.assign(lengths.size(), huffman_code());
+
+    // Codes of each length start where the shorter ones left off
+    uint32_t count[MAX_CODE_LENGTH + 1] = {0};
+    for (int length : lengths){
+        ++count[length];
+    }
+
+    uint32_t next[MAX_CODE_LENGTH + 1] = {0};
+    count[0] = 0;
+    for (int l = 1; l <= MAX_CODE_LENGTH; ++l){
+        next[l] = (next[l - 1] + count[l - 1]) << 1;
+    }
+
+    for (size_t symbol = 0; symbol < lengths.size(); ++symbol){
+        int length = lengths[symbol];
+        if (length > 0){
+            codes[symbol] = huffman_code(next[length]++, length);
+        }
+    }
+}
+
+// Appends the length table
+bool write_lengths(const std::vector<int> &lengths,
+                   std::vector<uint8_t> &out){
+
+    // Wide tables spend a second nibble on lengths of 15 and up
+    bool wide = lengths.size() > BYTE_ALPHABET;
+    int max_length = wide ? WIDE_LENGTH_LIMIT : LENGTH_LIMIT;
+
+    std::vector<uint8_t> nibbles;
+    for (size_t i = 0; i < lengths.size();){
+        if (lengths[i] > max_length){
+            return false;
+        }
+        if (wide && lengths[i] >= 15){
+            nibbles.push_back(15);
+            nibbles.push_back(lengths[i] - 15);
+            ++i;
+            continue;
+        }
+        if (lengths[i] > 0){
+            nibbles.push_back(lengths[i]);
+            ++i;
+            continue;
+        }
+
+        // Up to 16 symbols without a code in one escape
+        size_t run = 1;
+        while (run < 16 && i + run < lengths.size() && lengths[i + run] == 0){
+            ++run;
+        }
+        nibbles.push_back(0);
+        nibbles.push_back(run - 1);
+        i += run;
+    }
+
+    for (size_t i = 0; i < nibbles.size(); i += 2){
+        uint8_t high = nibbles[i];
+        uint8_t low = i + 1 < nibbles.size() ? nibbles[i + 1] : 0;
+        out.push_back((high << 4) | low);
+    }
+
+    return true;
+}
+
+// Reads alphabet_size lengths from data
+bool read_lengths(const uint8_t *data, size_t size, size_t alphabet_size,
+                  std::vector<int> &lengths, size_t &used){
+
+    lengths.assign(alphabet_size, 0);
+    bool wide = alphabet_size > BYTE_ALPHABET;
+    int max_length = wide ? WIDE_LENGTH_LIMIT : LENGTH_LIMIT;
+
+    size_t nibble = 0;
+    auto next = [&](int &value){
+        if (nibble / 2 >= size){
+            return false;
+        }
+        uint8_t byte = data[nibble / 2];
+        value = nibble % 2 == 0 ? byte >> 4 : byte & 15;
+        ++nibble;
+        return true;
+    };
+
+    for (size_t i = 0; i < alphabet_size;){
+        int value;
+        if (!next(value)){
+            return false;
+        }
+        if (wide && value == 15){
+            int rest;
+            if (!next(rest) || value + rest > max_length){
+                return false;
+            }
+            lengths[i++] = value + rest;
+            continue;
+        }
+        if (value > 0){
+            lengths[i++] = value;
+            continue;
+        }
+
+        int run;
+        if (!next(run)){
+            return false;
+        }
+        i += run + 1;
+    }
+    used = (nibble + 1) / 2;
+
+    // Kraft sum, a prefix code never goes over 1
+    uint64_t kraft = 0;
+    for (int length : lengths){
+        if (length > 0){
+            kraft += (uint64_t)1 << (max_length - length);
+        }
+    }
+    return kraft <= ((uint64_t)1 << max_length);
+}
+
+// Compresses size symbols of type T into a blob for alphabet_size symbols
+template <typename T>
+static std::vector<uint8_t> compress_symbols(const T *data, size_t size,
+                                             size_t alphabet_size,
+                                             int limit){
+    std::vector<uint8_t> blob;
+
+    std::vector<uint64_t> weights(alphabet_size, 0);
+    add_histogram(data, size, weights);
+
+    // A cap too short for the symbols present is raised until they fit,
+    // 65536 symbols need 16 bits whatever the caller asked for
+    int max_length = alphabet_size > BYTE_ALPHABET ? WIDE_LENGTH_LIMIT
+                                                   : LENGTH_LIMIT;
+    size_t present = weights.size()
+                     - std::count(weights.begin(), weights.end(), 0);
+    while (limit < max_length && ((size_t)1 << limit) < present){
+        ++limit;
+    }
+
+    std::vector<int> lengths;
+    std::vector<huffman_code> codes;
+    if (limit > max_length || !code_lengths(weights, limit, lengths)){
+        return blob;
+    }
+    canonical_codes(lengths, codes);
+    bitstream packed;
+    encode(codes, data, size, packed);
+
+    blob.insert(blob.end(), BLOB_MAGIC, BLOB_MAGIC + 4);
+    put_value(blob, (uint32_t)lengths.size());
+    put_value(blob, (uint64_t)size);
+    put_value(blob, (uint64_t)packed.bit_length);
+    write_lengths(lengths, blob);
+    blob.resize((blob.size() + 7) / 8 * 8, 0);
+
+    const uint8_t *raw = reinterpret_cast<const uint8_t*>(packed.words.data());
+    blob.insert(blob.end(), raw, raw + packed.words.size() * 8);
+
+    return blob;
+}
+
+// Decompresses a blob with at most max_alphabet symbols, appending to
+// decoded (a std::string or a vector of 16 bit symbols)
+template <typename C>
+static bool decompress_symbols(const uint8_t *blob, size_t size,
+                               size_t max_alphabet, C &decoded){
+
+    size_t offset = 4;
+    uint32_t alphabet_size;
+    uint64_t symbols, bit_length;
+    if (size < 4 || memcmp(blob, BLOB_MAGIC, 4) != 0
+        || !get_value(blob, size, offset, alphabet_size)
+        || !get_value(blob, size, offset, symbols)
+        || !get_value(blob, size, offset, bit_length)
+        || alphabet_size > max_alphabet){
+        return false;
+    }
+
+    std::vector<int> lengths;
+    size_t used;
+    if (!read_lengths(blob + offset, size - offset, alphabet_size, lengths,
+                      used)){
+        return false;
+    }
+    offset = (offset + used + 7) / 8 * 8;
+
+    // Bits are bounded by the bytes left before they are rounded to words,
+    // a garbage bit_length near 2^64 would wrap the word count to 0.
+    // Codes are at least a bit long, so symbols can not exceed the bits.
+    if (offset > size || bit_length > (uint64_t)(size - offset) * 8
+        || symbols > bit_length){
+        return false;
+    }
+    size_t num_words = (bit_length + 63) / 64;
+    if (num_words > (size - offset) / 8){
+        return false;
+    }
+
+    std::vector<huffman_code> codes;
+    decode_table table;
+    canonical_codes(lengths, codes);
+    make_decode_table(table, codes);
+
+    // The words are read in place when the blob lets them be aligned
+    std::vector<uint64_t> copy;
+    const uint64_t *words = reinterpret_cast<const uint64_t*>(blob + offset);
+    if ((uintptr_t)words % alignof(uint64_t) != 0){
+        copy.resize(num_words);
+        memcpy(copy.data(), blob + offset, num_words * 8);
+        words = copy.data();
+    }
+
+    if (symbols == 0){
+        return bit_length == 0;
+    }
+
+    size_t start = decoded.size();
+    decoded.resize(start + symbols);
+    if (!table_decode(table, words, num_words, bit_length, &decoded[start],
+                      symbols)){
+        decoded.resize(start);
+        return false;
+    }
+    return true;
+}
+
+// Compresses data into a self describing blob, byte alphabet
+std::vector<uint8_t> huffman_compress(const std::string &data, int limit){
+    return compress_symbols(data.data(), data.size(), BYTE_ALPHABET, limit);
+}
+
+// Decompresses a blob of huffman_compress, appending to decoded
+bool huffman_decompress(const uint8_t *blob, size_t size,
+                        std::string &decoded){
+    return decompress_symbols(blob, size, BYTE_ALPHABET, decoded);
+}
+
+// Same for 16 bit symbols
+std::vector<uint8_t> huffman_compress(const uint16_t *data, size_t size,
+                                      int limit){
+    return compress_symbols(data, size, WIDE_ALPHABET, limit);
+}
+
+// Decompresses a blob of either alphabet, appending to decoded
+bool huffman_decompress(const uint8_t *blob, size_t size,
+                        std::vector<uint16_t> &decoded){
+    return decompress_symbols(blob, size, WIDE_ALPHABET, decoded);
+}
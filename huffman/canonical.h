@@ -0,0 +1,109 @@
+/*-------------canonical.h----------------------------------------------------//
+*
+* Purpose: header file for canonical huffman codes, which follow from the
+*          code lengths alone, and for blobs that carry those lengths
+*
+*   Notes: Lengths come from package-merge, so they can be capped (at 15 by
+*          default) and are still the best codes under that cap.
+*          Blob layout, host byte order:
+*              "HUF1", alphabet size (u32), symbols (u64), bits (u64),
+*              length table, zero padding to 8 bytes, packed words
+*          The length table is one nibble per symbol, with 0 followed by a
+*          nibble n standing for n + 1 symbols without a code. Tables of
+*          the 16 bit alphabet write a length of 15 or more as 15 and a
+*          second nibble with the rest, so codes can reach 24 bits there.
+*          Symbols are bytes (alphabet 256) or 16 bit values (alphabet
+*          65536), e.g. pairs of bytes, always held in flat arrays indexed
+*          by the symbol. A cap too short for the symbols in the data is
+*          raised to the shortest that holds them, up to 16 for 16 bit
+*          symbols.
+*
+*-----------------------------------------------------------------------------*/
+
+#ifndef CANONICAL_H
+#define CANONICAL_H
+
+#include<cstring>
+#include "huffman_table.h"
+#include "huffman_pool.h"
+
+// Longest code by default, and the longest a byte length table can hold
+const int LENGTH_LIMIT = 15;
+
+// Longest code a 16 bit length table is allowed to hold
+const int WIDE_LENGTH_LIMIT = 24;
+
+// Symbols in the byte and the 16 bit alphabets
+const size_t BYTE_ALPHABET = 1 << 8;
+const size_t WIDE_ALPHABET = 1 << 16;
+
+// Adds the count of every byte of data to weights (256 entries)
+void add_histogram(const char *data, size_t size,
+                   std::vector<uint64_t> &weights);
+
+// Same for 16 bit symbols (65536 entries)
+void add_histogram(const uint16_t *data, size_t size,
+                   std::vector<uint64_t> &weights);
+
+// Finds the best code lengths no longer than limit for the weights, indexed
+// by symbol. Symbols of weight 0 get length 0. Returns false if there are
+// more than 2^limit symbols with weight, or limit > MAX_CODE_LENGTH.
+bool code_lengths(const std::vector<uint64_t> &weights, int limit,
+                  std::vector<int> &lengths);
+
+// Same, building the tree in pool, which keeps its memory between calls.
+// Package-merge is only run when the plain huffman code is over the limit.
+bool code_lengths(const std::vector<uint64_t> &weights, int limit,
+                  std::vector<int> &lengths, node_pool &pool);
+
+// Assigns canonical codes: shorter codes first, ties by symbol, each code
+// the previous one plus one (shifted left when the length grows)
+void canonical_codes(const std::vector<int> &lengths,
+                     std::vector<huffman_code> &codes);
+
+// Appends the length table, returns false if a length is over LENGTH_LIMIT
+// (WIDE_LENGTH_LIMIT for tables of more than BYTE_ALPHABET symbols)
+bool write_lengths(const std::vector<int> &lengths,
+                   std::vector<uint8_t> &out);
+
+// Reads alphabet_size lengths from data, used is set to the bytes read
+// Returns false if the table is cut short or the lengths are not a code
+bool read_lengths(const uint8_t *data, size_t size, size_t alphabet_size,
+                  std::vector<int> &lengths, size_t &used);
+
+// Appends the bytes of value to out, for blob headers
+template <typename T>
+inline void put_value(std::vector<uint8_t> &out, const T &value){
+    const uint8_t *raw = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), raw, raw + sizeof(T));
+}
+
+// Reads value at offset and moves past it, false if data ends first
+template <typename T>
+inline bool get_value(const uint8_t *data, size_t size, size_t &offset,
+                      T &value){
+    if (offset + sizeof(T) > size){
+        return false;
+    }
+    memcpy(&value, data + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+}
+
+// Compresses data into a self describing blob, byte alphabet
+std::vector<uint8_t> huffman_compress(const std::string &data,
+                                      int limit = LENGTH_LIMIT);
+
+// Decompresses a blob of huffman_compress, appending to decoded
+bool huffman_decompress(const uint8_t *blob, size_t size,
+                        std::string &decoded);
+
+// Same for 16 bit symbols, limit at most WIDE_LENGTH_LIMIT
+std::vector<uint8_t> huffman_compress(const uint16_t *data, size_t size,
+                                      int limit = LENGTH_LIMIT);
+
+// Decompresses a blob of either alphabet, appending to decoded
+bool huffman_decompress(const uint8_t *blob, size_t size,
+                        std::vector<uint16_t> &decoded);
+
+#endif
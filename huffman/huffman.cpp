@@ -6,7 +6,10 @@
 *-----------------------------------------------------------------------------*/
 
 #include<iostream>
+#include<algorithm>
 #include "huffman.h"
+#include "huffman_table.h"
+#include "canonical.h"
 
 /*----------------------------------------------------------------------------//
 * MAIN
@@ -68,6 +71,18 @@ node_queue create_nodes(std::unordered_map<char, double> &keyweights){
 
 }
 
+// Overloaded create_nodes function for dense weights
+node_queue create_nodes(const std::vector<uint64_t> &weights){
+    node_queue initial_nodes;
+
+    for (size_t i = 0; i < weights.size(); ++i){
+        if (weights[i] > 0){
+            initial_nodes.push(new node((char)i, weights[i]));
+        }
+    }
+    return initial_nodes;
+}
+
 // Creates the simple binary tree
 node* huffman(node_queue &initial_nodes, std::vector<node*> &internal,
               std::vector<node*> &external){
@@ -80,7 +95,7 @@ node* huffman(node_queue &initial_nodes, std::vector<node*> &internal,
         node1 = initial_nodes.top();
 
         // Check to see if node is an internal or external node
-        if (node1->key){
+        if (is_leaf(node1)){
             // External node
             external.push_back(node1);
         }
@@ -93,7 +108,7 @@ node* huffman(node_queue &initial_nodes, std::vector<node*> &internal,
         node2 = initial_nodes.top();
 
         // Check to see if node is an internal or external node
-        if (node2->key){
+        if (is_leaf(node2)){
             // External node
             external.push_back(node2);
         }
@@ -144,6 +159,11 @@ std::unordered_map<char, std::string> create_bits(node* &root){
         //std::cout << bitstrings[i].key << '\t' << bitstrings[i].code << '\n';
     }
 
+    // A lone leaf is the root, it still needs a bit per key to be decoded
+    if (bitstrings.size() == 1){
+        bitmap[bitstrings[0].key] = "0";
+    }
+
     return bitmap;
 }
 
@@ -186,6 +206,27 @@ void depth_first_search(node* &root, node_queue &regenerated_nodes){
 }
 
 
+// Turns the bitmap into integer codes, indexed by the key as unsigned char
+bool integer_codes(std::unordered_map<char, std::string> &bitmap,
+                   std::vector<huffman_code> &codes){
+
+    codes.assign(BYTE_ALPHABET, huffman_code());
+    for (auto& key : bitmap){
+        if (key.second.size() > (size_t)MAX_CODE_LENGTH){
+            return false;
+        }
+
+        // A tree of a single key gives it the empty code, make that "0"
+        huffman_code &code = codes[(unsigned char)key.first];
+        code.length = std::max(key.second.size(), (size_t)1);
+        for (char bit : key.second){
+            code.bits = (code.bits << 1) | (bit == '1');
+        }
+    }
+
+    return true;
+}
+
 // does the encoding -- Assuming that all characters in phrase are already
 // encoded in bitmap
 std::string encode(std::unordered_map<char, std::string> &bitmap, 
@@ -202,27 +243,63 @@ std::string encode(std::unordered_map<char, std::string> &bitmap,
     return encoded_phrase;
 }
 
+// Encodes phrase with integer codes into packed bits
+bitstream encode(const std::vector<huffman_code> &codes,
+                 const std::string &phrase){
+
+    bitstream packed;
+    packed.words.reserve(phrase.size() / 8 + 1);
+    encode(codes, phrase.data(), phrase.size(), packed);
+
+    return packed;
+}
+
+// Encodes symbols of any unsigned type, which index codes directly
+template <typename T>
+static void encode_symbols(const std::vector<huffman_code> &codes,
+                           const T *data, size_t size, bitstream &packed){
+
+    packed.words.clear();
+    packed.bit_length = 0;
+    bit_writer writer(packed);
+
+    for (size_t i = 0; i < size; ++i){
+        const huffman_code &code = codes[data[i]];
+        writer.put(code.bits, code.length);
+    }
+    writer.finish();
+}
+
+// Same for size bytes at data, packed is cleared first and keeps its memory
+void encode(const std::vector<huffman_code> &codes, const char *data,
+            size_t size, bitstream &packed){
+    encode_symbols(codes, reinterpret_cast<const unsigned char*>(data), size,
+                   packed);
+}
+
+// Same for 16 bit symbols
+void encode(const std::vector<huffman_code> &codes, const uint16_t *data,
+            size_t size, bitstream &packed){
+    encode_symbols(codes, data, size, packed);
+}
+
 // Does a simple 2-pass encoding scheme
 huffman_tree two_pass_huffman(std::string &phrase){
 
     huffman_tree final_tree;
     final_tree.phrase = phrase;
 
-    // Adding weights to the weightmap in our final huffman tree
-    for (size_t i = 0; i < phrase.size(); ++i){
-        if(final_tree.weightmap[phrase[i]]){
-            final_tree.weightmap[phrase[i]] += 1;
-        }
-        else{
-            final_tree.weightmap[phrase[i]] = 1;
-        }
-    }
+    // Counting every byte into the weights of our final huffman tree
+    final_tree.weights.assign(BYTE_ALPHABET, 0);
+    add_histogram(phrase.data(), phrase.size(), final_tree.weights);
 
     // finding size of alphabet
-    final_tree.alphabet_size = final_tree.weightmap.size();
+    final_tree.alphabet_size = std::count_if(final_tree.weights.begin(),
+                                             final_tree.weights.end(),
+                                             [](uint64_t w){return w > 0;});
 
     // Creating initial external nodes
-    node_queue initial_nodes = create_nodes(final_tree.weightmap);
+    node_queue initial_nodes = create_nodes(final_tree.weights);
 
     // Performing huffman algorithm
 
@@ -253,8 +330,16 @@ huffman_tree two_pass_huffman(std::string &phrase){
         std::cout << key.first << '\t' << key.second << '\n';
     }
 
-    // Doing the encoding of our phrase
-    final_tree.encoded_phrase = encode(final_tree.bitmap, phrase);
+    // Doing the encoding of our phrase, packed with integer codes
+    if (!integer_codes(final_tree.bitmap, final_tree.codes)){
+        std::cout << "codes are too long to pack" << '\n';
+        return final_tree;
+    }
+    final_tree.packed = encode(final_tree.codes, phrase);
+
+    std::cout << "phrase is: " << phrase << '\n';
+    std::cout << "encoded phrase is: " << bit_string(final_tree.packed)
+              << '\n';
 
     // finding size of alphabet
     //final_tree.alphabet_size = final_tree.bitmap.size();
@@ -263,25 +348,14 @@ huffman_tree two_pass_huffman(std::string &phrase){
 
 }
 
-// Simple decoding scheme
+// Simple decoding scheme, through the lookup tables of huffman_table.h
 void decode(huffman_tree &encoded_tree){
-    
-    // Create decoding map
-    std::unordered_map<std::string, char> decoding_map;
-    for (auto& key : encoded_tree.bitmap){
-        decoding_map[key.second] = key.first;
-    }
 
-    // Now we iterate through the string
-    std::string temp_string, decoded_phrase;
-    for (size_t i = 0; i < encoded_tree.encoded_phrase.size(); ++i){
-        temp_string += encoded_tree.encoded_phrase[i];
-        if (decoding_map[temp_string]){
-            decoded_phrase += decoding_map[temp_string];
-            temp_string = "";
-        }
+    std::string decoded_phrase;
+    if (!table_decode(encoded_tree, decoded_phrase)){
+        std::cout << "could not decode phrase" << '\n';
+        return;
     }
 
     std::cout << "decoded phrase is: " << decoded_phrase << '\n';
 }
-
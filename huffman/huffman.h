@@ -7,38 +7,34 @@
 #ifndef HUFFMAN_H
 #define HUFFMAN_H
 
+#include<cstdint>
 #include<vector>
 #include<string>
 #include<unordered_map>
 #include<queue>
-
-// Struct to hold positions
-struct pos{
-    double x, y;
-};
-
-// Struct for colors
-struct color{
-    double r, g, b;
-};
-
+#include "bitstream.h"
 
 // Create the binary tree
+// Only what coding needs, drawing keeps its positions apart (huffman_vis)
 struct node{
     char key;
     double weight;
-    pos ori;
 
     node() = default;
     node(char k, double w){
         key = k;
         weight = w;
     };
-    node *left;
-    node *right;
-    node *parent;
+    node *left = nullptr;
+    node *right = nullptr;
+    node *parent = nullptr;
 };
 
+// Leaves are told apart by having no children, any key (0 too) is a leaf
+inline bool is_leaf(const node *n){
+    return !n->left && !n->right;
+}
+
 // Struct to compare nodes
 struct node_comparer{
     bool operator()(const node *left, const node *right) const {
@@ -55,18 +51,36 @@ struct huffman_cp{
     char key;
 };
 
+// Integer form of a code, read from the highest of its length bits down
+// A length of 0 marks a symbol that has no code
+struct huffman_code{
+    uint32_t bits;
+    int length;
+
+    huffman_code() : bits(0), length(0) {}
+    huffman_code(uint32_t b, int l) : bits(b), length(l) {}
+};
+
+// Longest code that fits in huffman_code
+const int MAX_CODE_LENGTH = 32;
+
 // Struct to hold final result before decoding
 struct huffman_tree{
     node *root;
     std::unordered_map<char, std::string> bitmap;
-    std::string phrase, encoded_phrase;
-    std::unordered_map<char, double> weightmap;
+    std::string phrase;
+
+    // Count of every key, indexed by the key as unsigned char
+    std::vector<uint64_t> weights;
+
+    // Codes indexed by the key as unsigned char, and the phrase encoded with
+    // them. packed.bit_length is the exact number of bits.
+    std::vector<huffman_code> codes;
+    bitstream packed;
     int alphabet_size;
 
-    // Note: These will be used for vitter algorithm testing
+    // Nodes in the order huffman() merged them
     std::vector<node*> internal, external;
-    std::unordered_map<char, node*> nodemap;
-    node *NYT;
 };
 
 using node_queue = std::priority_queue<node*,std::vector<node*>,node_comparer>;
@@ -75,6 +89,10 @@ using node_queue = std::priority_queue<node*,std::vector<node*>,node_comparer>;
 node_queue create_nodes(std::vector<char> &keys, std::vector<double> &weights);
 node_queue create_nodes(std::unordered_map<char, double> &keyweights);
 
+// Same for dense weights indexed by the key as unsigned char, a leaf for
+// every key with weight
+node_queue create_nodes(const std::vector<uint64_t> &weights);
+
 // Creates the simple binary tree
 node* huffman(node_queue &initial_nodes, std::vector<node*> &internal,
               std::vector<node*> &external);
@@ -83,10 +101,27 @@ node* huffman(node_queue &initial_nodes, std::vector<node*> &internal,
 //std::vector<huffman_cp> create_bits(node* root);
 std::unordered_map<char, std::string> create_bits(node* &root);
 
+// Turns the bitmap into integer codes, indexed by the key as unsigned char
+// Returns false if a code is longer than MAX_CODE_LENGTH
+bool integer_codes(std::unordered_map<char, std::string> &bitmap,
+                   std::vector<huffman_code> &codes);
+
 // does the encoding
 std::string encode(std::unordered_map<char, std::string> &bitmap, 
                    std::string &phrase);
 
+// Encodes phrase with integer codes into packed bits
+bitstream encode(const std::vector<huffman_code> &codes,
+                 const std::string &phrase);
+
+// Same for size bytes at data, packed is cleared first and keeps its memory
+void encode(const std::vector<huffman_code> &codes, const char *data,
+            size_t size, bitstream &packed);
+
+// Same for 16 bit symbols, codes has an entry for each of the 65536
+void encode(const std::vector<huffman_code> &codes, const uint16_t *data,
+            size_t size, bitstream &packed);
+
 // Does a simple search
 void depth_first_search(node* &root, huffman_cp &current,
                                       std::vector<huffman_cp> &bitstrings);
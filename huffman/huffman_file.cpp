@@ -0,0 +1,124 @@
+/*-------------huffman_file.cpp-----------------------------------------------//
+*
+* Purpose: Command line tool to compress files (simulation dumps and the
+*          like) with the streaming huffman coder
+*
+*   Notes: build with make huffman_file, run with
+*              ./huffman_file c [-a | -b | -p] [-s block_bytes] in out
+*              ./huffman_file d [-p] in out
+*          -a codes adaptively in one pass, -b gives every block its own
+*          table; in can be a pipe with either.
+*          -p codes the whole file in memory with block parallel coding on
+*          all cores, and has to be given to d as well.
+*          "-" reads stdin or writes stdout.
+*
+*-----------------------------------------------------------------------------*/
+
+#include<cstdio>
+#include<cstdlib>
+#include<cstring>
+#include<iostream>
+#include "huffman_stream.h"
+#include "huffman_parallel.h"
+
+// Function to read all of a file, "-" is stdin
+static bool read_all(const std::string &path, std::string &data){
+    FILE *in = path == "-" ? stdin : fopen(path.c_str(), "rb");
+    if (!in){
+        return false;
+    }
+
+    char buffer[1 << 16];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), in)) > 0){
+        data.append(buffer, size);
+    }
+    bool ok = !ferror(in);
+    return (in == stdin || fclose(in) == 0) && ok;
+}
+
+// Function to write all of data to a file, "-" is stdout
+static bool write_all(const std::string &path, const void *data, size_t size){
+    FILE *out = path == "-" ? stdout : fopen(path.c_str(), "wb");
+    if (!out){
+        return false;
+    }
+
+    bool ok = fwrite(data, 1, size, out) == size;
+    return (out == stdout ? fflush(out) == 0 : fclose(out) == 0) && ok;
+}
+
+// Compresses or decompresses with block parallel coding, in memory
+static bool parallel_file(bool compress, const std::string &in_path,
+                          const std::string &out_path, size_t block_size){
+    std::string data;
+    if (!read_all(in_path, data)){
+        return false;
+    }
+
+    if (compress){
+        std::vector<uint8_t> blob = parallel_compress(data.data(),
+                                                      data.size(),
+                                                      block_size);
+        return !blob.empty() && write_all(out_path, blob.data(), blob.size());
+    }
+
+    std::string decoded;
+    return parallel_decompress((const uint8_t*)data.data(), data.size(),
+                               decoded)
+           && write_all(out_path, decoded.data(), decoded.size());
+}
+
+/*----------------------------------------------------------------------------//
+* MAIN
+*-----------------------------------------------------------------------------*/
+
+int main(int argc, char **argv){
+    if (argc < 4 || (strcmp(argv[1], "c") != 0 && strcmp(argv[1], "d") != 0)){
+        std::cerr << "usage: " << argv[0]
+                  << " c [-a | -b | -p] [-s block_bytes] in out\n"
+                  << "       " << argv[0] << " d [-p] in out\n";
+        return 1;
+    }
+
+    stream_options opt;
+    bool parallel = false;
+    bool block_given = false;
+    int arg = 2;
+    while (arg < argc - 2){
+        if (strcmp(argv[arg], "-a") == 0){
+            opt.adaptive = true;
+        }
+        else if (strcmp(argv[arg], "-b") == 0){
+            opt.per_block_table = true;
+        }
+        else if (strcmp(argv[arg], "-p") == 0){
+            parallel = true;
+        }
+        else if (strcmp(argv[arg], "-s") == 0 && arg + 1 < argc - 2){
+            opt.block_size = strtoull(argv[++arg], nullptr, 10);
+            block_given = true;
+        }
+        else{
+            std::cerr << "unknown option " << argv[arg] << '\n';
+            return 1;
+        }
+        ++arg;
+    }
+
+    bool compress = argv[1][0] == 'c';
+    bool ok;
+    if (parallel){
+        ok = parallel_file(compress, argv[argc - 2], argv[argc - 1],
+                           block_given ? opt.block_size : PARALLEL_BLOCK);
+    }
+    else{
+        ok = compress
+             ? compress_file(argv[argc - 2], argv[argc - 1], opt)
+             : decompress_file(argv[argc - 2], argv[argc - 1]);
+    }
+    if (!ok){
+        std::cerr << "failed on " << argv[argc - 2] << '\n';
+        return 1;
+    }
+}
@@ -0,0 +1,188 @@
+/*-------------huffman_parallel.cpp-------------------------------------------//
+*
+* Purpose: Huffman coding on all cores: histogram, encoding and decoding
+*          are all split over blocks
+*
+*-----------------------------------------------------------------------------*/
+
+#include<algorithm>
+#include "huffman_parallel.h"
+
+const char PARALLEL_MAGIC[4] = {'H', 'U', 'F', 'P'};
+
+// Where a block sits in the packed words
+struct block_index{
+    uint64_t first_word;
+    uint64_t bit_length;
+};
+
+// Adds the count of every byte of data to weights, in parallel
+void parallel_histogram(const char *data, size_t size,
+                        std::vector<uint64_t> &weights){
+
+    #pragma omp parallel
+    {
+        std::vector<uint64_t> local(weights.size(), 0);
+
+        #pragma omp for schedule(static)
+        for (size_t i = 0; i < size; ++i){
+            ++local[(unsigned char)data[i]];
+        }
+
+        #pragma omp critical
+        for (size_t s = 0; s < weights.size(); ++s){
+            weights[s] += local[s];
+        }
+    }
+}
+
+// Compresses data into an indexed blob
+std::vector<uint8_t> parallel_compress(const char *data, size_t size,
+                                       size_t block_size, int limit){
+    std::vector<uint8_t> blob;
+
+    std::vector<uint64_t> weights(BYTE_ALPHABET, 0);
+    parallel_histogram(data, size, weights);
+
+    std::vector<int> lengths;
+    std::vector<huffman_code> codes;
+    if (block_size == 0 || limit > LENGTH_LIMIT
+        || !code_lengths(weights, limit, lengths)){
+        return blob;
+    }
+    canonical_codes(lengths, codes);
+
+    // Every block into its own words
+    size_t num_blocks = (size + block_size - 1) / block_size;
+    std::vector<bitstream> packed(num_blocks);
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (size_t b = 0; b < num_blocks; ++b){
+        size_t first = b * block_size;
+        encode(codes, data + first, std::min(block_size, size - first),
+               packed[b]);
+    }
+
+    std::vector<block_index> index(num_blocks);
+    uint64_t num_words = 0;
+    for (size_t b = 0; b < num_blocks; ++b){
+        index[b].first_word = num_words;
+        index[b].bit_length = packed[b].bit_length;
+        num_words += packed[b].words.size();
+    }
+
+    blob.insert(blob.end(), PARALLEL_MAGIC, PARALLEL_MAGIC + 4);
+    put_value(blob, (uint32_t)lengths.size());
+    put_value(blob, (uint64_t)size);
+    put_value(blob, (uint64_t)block_size);
+    put_value(blob, (uint64_t)num_blocks);
+    write_lengths(lengths, blob);
+    blob.resize((blob.size() + 7) / 8 * 8, 0);
+    for (auto &entry : index){
+        put_value(blob, entry);
+    }
+
+    // Blocks copied into place by the threads that made them
+    size_t words_offset = blob.size();
+    blob.resize(words_offset + num_words * 8);
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (size_t b = 0; b < num_blocks; ++b){
+        memcpy(&blob[words_offset + index[b].first_word * 8],
+               packed[b].words.data(), packed[b].words.size() * 8);
+    }
+
+    return blob;
+}
+
+// Decompresses a blob of parallel_compress, appending to decoded
+bool parallel_decompress(const uint8_t *blob, size_t size,
+                         std::string &decoded){
+
+    size_t offset = 4;
+    uint32_t alphabet_size;
+    uint64_t symbols, block_size, num_blocks;
+    if (size < 4 || memcmp(blob, PARALLEL_MAGIC, 4) != 0
+        || !get_value(blob, size, offset, alphabet_size)
+        || !get_value(blob, size, offset, symbols)
+        || !get_value(blob, size, offset, block_size)
+        || !get_value(blob, size, offset, num_blocks)
+        || block_size == 0 || alphabet_size > BYTE_ALPHABET
+        || num_blocks != symbols / block_size + (symbols % block_size != 0)){
+        return false;
+    }
+
+    std::vector<int> lengths;
+    size_t used;
+    if (!read_lengths(blob + offset, size - offset, alphabet_size, lengths,
+                      used)){
+        return false;
+    }
+    offset = (offset + used + 7) / 8 * 8;
+
+    // The index has to fit the blob before it is allocated
+    if (offset > size
+        || num_blocks > (size - offset) / sizeof(block_index)){
+        return false;
+    }
+    std::vector<block_index> index(num_blocks);
+    for (auto &entry : index){
+        if (!get_value(blob, size, offset, entry)){
+            return false;
+        }
+    }
+
+    // Words are read in place when the blob lets them be aligned
+    size_t num_words = (size - offset) / 8;
+    std::vector<uint64_t> copy;
+    const uint64_t *words = reinterpret_cast<const uint64_t*>(blob + offset);
+    if ((uintptr_t)words % alignof(uint64_t) != 0){
+        copy.resize(num_words);
+        memcpy(copy.data(), blob + offset, num_words * 8);
+        words = copy.data();
+    }
+
+    // Blocks follow each other without gaps or overlaps and fill the words
+    // exactly, so all their bits together are bounded by the blob. Codes
+    // are at least a bit long, so a block's symbols can not exceed its
+    // bits. Bits are checked against the words left before rounding.
+    uint64_t next_word = 0, total_bits = 0;
+    for (size_t b = 0; b < num_blocks; ++b){
+        const block_index &entry = index[b];
+        if (entry.first_word != next_word
+            || entry.bit_length > (num_words - next_word) * 64
+            || std::min(block_size, symbols - b * block_size)
+               > entry.bit_length){
+            return false;
+        }
+        next_word += (entry.bit_length + 63) / 64;
+        total_bits += entry.bit_length;
+    }
+    if (next_word != num_words || symbols > total_bits){
+        return false;
+    }
+
+    std::vector<huffman_code> codes;
+    decode_table table;
+    canonical_codes(lengths, codes);
+    make_decode_table(table, codes);
+
+    size_t start = decoded.size();
+    decoded.resize(start + symbols);
+    bool ok = true;
+
+    #pragma omp parallel for schedule(dynamic, 1) reduction(&&:ok)
+    for (size_t b = 0; b < num_blocks; ++b){
+        size_t first = b * block_size;
+        const block_index &entry = index[b];
+        ok = table_decode(table, words + entry.first_word,
+                          (entry.bit_length + 63) / 64, entry.bit_length,
+                          &decoded[start + first],
+                          std::min(block_size, symbols - first)) && ok;
+    }
+
+    if (!ok){
+        decoded.resize(start);
+    }
+    return ok;
+}
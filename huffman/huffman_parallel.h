@@ -0,0 +1,38 @@
+/*-------------huffman_parallel.h---------------------------------------------//
+*
+* Purpose: header file for block parallel huffman coding with OpenMP
+*
+*   Notes: The input is cut into blocks of block_size bytes that share one
+*          canonical code. Every block starts on a word and the header holds
+*          an index of where, so blocks decode on their own, in any order.
+*          Blob layout, host byte order:
+*              "HUFP", alphabet size (u32), symbols (u64), block size (u64),
+*              blocks (u64), length table, zero padding to 8 bytes,
+*              index: per block first word (u64) and bits (u64),
+*              packed words of all blocks
+*
+*-----------------------------------------------------------------------------*/
+
+#ifndef HUFFMAN_PARALLEL_H
+#define HUFFMAN_PARALLEL_H
+
+#include "canonical.h"
+
+// Bytes per block by default, enough blocks for every core from a few MB
+const size_t PARALLEL_BLOCK = 1 << 18;
+
+// Adds the count of every byte of data to weights (256 entries), with
+// every thread counting a part on its own
+void parallel_histogram(const char *data, size_t size,
+                        std::vector<uint64_t> &weights);
+
+// Compresses data into an indexed blob, an empty blob if limit is invalid
+std::vector<uint8_t> parallel_compress(const char *data, size_t size,
+                                       size_t block_size = PARALLEL_BLOCK,
+                                       int limit = LENGTH_LIMIT);
+
+// Decompresses a blob of parallel_compress, appending to decoded
+bool parallel_decompress(const uint8_t *blob, size_t size,
+                         std::string &decoded);
+
+#endif
@@ -0,0 +1,105 @@
+/*-------------huffman_pool.cpp-----------------------------------------------//
+*
+* Purpose: Huffman trees in a flat pool, built with two queues from the
+*          leaves sorted by weight
+*
+*-----------------------------------------------------------------------------*/
+
+#include<algorithm>
+#include "huffman_pool.h"
+
+// Low bits of a sort key holding the symbol
+const int SYMBOL_BITS = 16;
+const uint64_t SYMBOL_MASK = ((uint64_t)1 << SYMBOL_BITS) - 1;
+
+// Builds the huffman tree of the weights in pool
+void build_tree(const std::vector<uint64_t> &weights, node_pool &pool){
+    std::vector<pool_node> &nodes = pool.nodes;
+    std::vector<uint64_t> &keys = pool.keys;
+
+    // Ties go to the lower symbol, so a build is always the same tree.
+    // Weights and symbols that fit sort as one integer, which is faster.
+    nodes.clear();
+    keys.clear();
+    bool packed = weights.size() <= SYMBOL_MASK + 1;
+    for (size_t i = 0; i < weights.size(); ++i){
+        if (weights[i] > 0){
+            nodes.push_back(pool_node{weights[i], -1, -1, (int)i});
+            keys.push_back((weights[i] << SYMBOL_BITS) | i);
+            packed = packed && weights[i] <= (UINT64_MAX >> SYMBOL_BITS);
+        }
+    }
+
+    if (packed){
+        std::sort(keys.begin(), keys.end());
+        for (size_t i = 0; i < keys.size(); ++i){
+            nodes[i] = pool_node{keys[i] >> SYMBOL_BITS, -1, -1,
+                                 (int)(keys[i] & SYMBOL_MASK)};
+        }
+    }
+    else{
+        std::sort(nodes.begin(), nodes.end(),
+                  [](const pool_node &a, const pool_node &b)
+                      {return a.weight < b.weight
+                              || (a.weight == b.weight
+                                  && a.symbol < b.symbol);});
+    }
+
+    int n = nodes.size();
+    pool.leaves = n;
+    pool.root = n - 1;
+    if (n < 2){
+        return;
+    }
+
+    // Lightest of the two queues, leaves win ties
+    int next_leaf = 0, next_inner = n;
+    auto lightest = [&](){
+        if (next_leaf < n && (next_inner == (int)nodes.size()
+                              || nodes[next_leaf].weight
+                                 <= nodes[next_inner].weight)){
+            return next_leaf++;
+        }
+        return next_inner++;
+    };
+
+    for (int k = 0; k < n - 1; ++k){
+        int a = lightest();
+        int b = lightest();
+        nodes.push_back(pool_node{nodes[a].weight + nodes[b].weight, a, b,
+                                  -1});
+    }
+    pool.root = nodes.size() - 1;
+}
+
+// Sets lengths to the depths of the leaves of a built tree
+int tree_lengths(node_pool &pool, size_t alphabet_size,
+                 std::vector<int> &lengths){
+    lengths.assign(alphabet_size, 0);
+    if (pool.leaves == 0){
+        return 0;
+    }
+    if (pool.leaves == 1){
+        lengths[pool.nodes[0].symbol] = 1;
+        return 1;
+    }
+
+    // Children always come before their parent, so one pass down from the
+    // root has every parent done before its children
+    pool.depth.resize(pool.nodes.size());
+    pool.depth[pool.root] = 0;
+    int longest = 0;
+    for (int i = pool.root; i >= 0; --i){
+        const pool_node &n = pool.nodes[i];
+        if (n.symbol >= 0){
+            lengths[n.symbol] = pool.depth[i];
+            longest = std::max(longest, pool.depth[i]);
+        }
+        else{
+            pool.depth[n.left] = pool.depth[i] + 1;
+            pool.depth[n.right] = pool.depth[i] + 1;
+        }
+    }
+
+    return longest;
+}
@@ -0,0 +1,57 @@
+/*-------------huffman_pool.h-------------------------------------------------//
+*
+* Purpose: header file for building huffman trees without allocating, in
+*          a flat pool of nodes linked by index
+*
+*   Notes: Leaves are sorted by weight into the front of the pool and the
+*          internal nodes follow in the order they are made. Made nodes
+*          never get lighter, so the two ranges are the two queues of the
+*          O(n) method and no heap is needed. The pool keeps its memory,
+*          so building again (a new table per block) costs a sort and a
+*          pass over the nodes.
+*
+*-----------------------------------------------------------------------------*/
+
+#ifndef HUFFMAN_POOL_H
+#define HUFFMAN_POOL_H
+
+#include<cstddef>
+#include<cstdint>
+#include<vector>
+
+struct pool_node{
+    uint64_t weight;
+
+    // Children, -1 for leaves
+    int left, right;
+
+    // Symbol of a leaf, -1 for internal nodes
+    int symbol;
+};
+
+struct node_pool{
+    std::vector<pool_node> nodes;
+
+    // Weight and symbol of every leaf in one integer, for sorting
+    std::vector<uint64_t> keys;
+
+    // Depth of every node, for working out code lengths
+    std::vector<int> depth;
+
+    // Leaves, and the root (the last node), -1 if there are no leaves
+    int leaves;
+    int root;
+
+    node_pool() : leaves(0), root(-1) {}
+};
+
+// Builds the huffman tree of the weights (indexed by symbol) in pool,
+// with a leaf for every symbol of weight > 0
+void build_tree(const std::vector<uint64_t> &weights, node_pool &pool);
+
+// Sets lengths (one per symbol, 0 without a leaf) to the depths of the
+// leaves of a built tree, a lone leaf gets 1. Returns the longest.
+int tree_lengths(node_pool &pool, size_t alphabet_size,
+                 std::vector<int> &lengths);
+
+#endif
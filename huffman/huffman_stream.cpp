@@ -0,0 +1,325 @@
+/*-------------huffman_stream.cpp---------------------------------------------//
+*
+* Purpose: Compress and decompress files block by block with canonical
+*          huffman codes, one table per file or one per block
+*
+*-----------------------------------------------------------------------------*/
+
+#include<cstdio>
+#include<cstring>
+#include "huffman_stream.h"
+
+const char STREAM_MAGIC[4] = {'H', 'U', 'F', 'S'};
+const uint32_t STREAM_VERSION = 1;
+
+// Byte alphabet, the only one the stream writes so far
+const uint32_t STREAM_ALPHABET = BYTE_ALPHABET;
+
+// A length table takes at most two nibbles a symbol (a lone zero)
+const size_t STREAM_MAX_TABLE = STREAM_ALPHABET;
+
+struct stream_header{
+    char magic[4];
+    uint32_t version;
+    uint64_t block_size;
+    uint32_t alphabet_size;
+    uint32_t per_block;
+    uint32_t table_bytes;
+    uint32_t adaptive;
+};
+
+struct block_header{
+    uint64_t size;
+    uint64_t bit_length;
+    uint32_t table_bytes;
+    uint32_t unused;
+};
+
+// Code of a stream, with its length table as written to the file
+struct stream_code{
+    std::vector<huffman_code> codes;
+    std::vector<uint8_t> table;
+    decode_table decoder;
+
+    // Kept from block to block, so a new code does not allocate
+    std::vector<int> lengths;
+    node_pool pool;
+};
+
+// Function to open a file, "-" is stdin or stdout
+static FILE* open_file(const std::string &path, const char *mode){
+    if (path == "-"){
+        return mode[0] == 'r' ? stdin : stdout;
+    }
+    return fopen(path.c_str(), mode);
+}
+
+static bool close_file(FILE *file){
+    if (!file){
+        return false;
+    }
+    if (file == stdin || file == stdout){
+        return fflush(file) == 0;
+    }
+    return fclose(file) == 0;
+}
+
+// Reads up to block_size bytes, fewer only at the end of the file
+static size_t read_block(FILE *in, std::string &buffer, size_t block_size){
+    buffer.resize(block_size);
+    size_t size = fread(&buffer[0], 1, block_size, in);
+    buffer.resize(size);
+    return size;
+}
+
+// Function to find the code and length table for the weights
+static bool make_code(const std::vector<uint64_t> &weights, int limit,
+                      stream_code &code){
+    code.table.clear();
+    if (!code_lengths(weights, limit, code.lengths, code.pool)
+        || !write_lengths(code.lengths, code.table)){
+        return false;
+    }
+    canonical_codes(code.lengths, code.codes);
+    return true;
+}
+
+// Function to read a length table back into a code
+static bool read_code(FILE *in, size_t table_bytes, stream_code &code){
+    size_t used;
+    if (table_bytes > STREAM_MAX_TABLE){
+        return false;
+    }
+    code.table.resize(table_bytes);
+    if (fread(code.table.data(), 1, table_bytes, in) != table_bytes
+        || !read_lengths(code.table.data(), table_bytes, STREAM_ALPHABET,
+                         code.lengths, used)){
+        return false;
+    }
+    canonical_codes(code.lengths, code.codes);
+    return make_decode_table(code.decoder, code.codes);
+}
+
+// Function to write a block header and what follows it
+static bool write_block(FILE *out, const std::string &buffer,
+                        const std::vector<uint8_t> &table,
+                        const bitstream &packed){
+    block_header block;
+    block.size = buffer.size();
+    block.bit_length = packed.bit_length;
+    block.table_bytes = table.size();
+    block.unused = 0;
+    return fwrite(&block, sizeof(block), 1, out) == 1
+           && fwrite(table.data(), 1, table.size(), out) == table.size()
+           && fwrite(packed.words.data(), 8, packed.words.size(), out)
+              == packed.words.size();
+}
+
+// Does the compressing, in and out are open
+static bool compress(FILE *in, FILE *out, const stream_options &opt){
+    if (opt.block_size == 0 || opt.block_size > STREAM_MAX_BLOCK
+        || opt.limit > LENGTH_LIMIT){
+        return false;
+    }
+
+    std::string buffer;
+    stream_code code;
+    std::vector<uint64_t> weights(STREAM_ALPHABET, 0);
+
+    // One table for all: histogram of the whole file first, then start over
+    if (!opt.per_block_table && !opt.adaptive){
+        while (read_block(in, buffer, opt.block_size) > 0){
+            add_histogram(buffer.data(), buffer.size(), weights);
+        }
+        if (ferror(in) || fseek(in, 0, SEEK_SET) != 0
+            || !make_code(weights, opt.limit, code)){
+            return false;
+        }
+    }
+
+    stream_header header;
+    memcpy(header.magic, STREAM_MAGIC, sizeof(header.magic));
+    header.version = STREAM_VERSION;
+    header.block_size = opt.block_size;
+    header.alphabet_size = STREAM_ALPHABET;
+    header.per_block = opt.per_block_table && !opt.adaptive;
+    header.table_bytes = code.table.size();
+    header.adaptive = opt.adaptive;
+    if (fwrite(&header, sizeof(header), 1, out) != 1
+        || fwrite(code.table.data(), 1, header.table_bytes, out)
+           != header.table_bytes){
+        return false;
+    }
+
+    // The adaptive tree carries on from block to block
+    adaptive_tree tree;
+    bitstream packed;
+    std::vector<uint8_t> no_table;
+    while (read_block(in, buffer, opt.block_size) > 0){
+        if (opt.adaptive){
+            adaptive_encode(tree, buffer.data(), buffer.size(), packed);
+        }
+        else{
+            if (header.per_block){
+                std::fill(weights.begin(), weights.end(), 0);
+                add_histogram(buffer.data(), buffer.size(), weights);
+                if (!make_code(weights, opt.limit, code)){
+                    return false;
+                }
+            }
+            encode(code.codes, buffer.data(), buffer.size(), packed);
+        }
+
+        if (!write_block(out, buffer, header.per_block ? code.table
+                                                       : no_table,
+                         packed)){
+            return false;
+        }
+    }
+
+    block_header end = {0, 0, 0, 0};
+    return !ferror(in) && fwrite(&end, sizeof(end), 1, out) == 1;
+}
+
+// Packed words held at once, so a block never has to fit in memory
+const size_t STREAM_CHUNK_WORDS = (size_t)1 << 16;
+
+// Bytes decoded before they go out
+const size_t STREAM_CHUNK_BYTES = (size_t)1 << 16;
+
+// Decodes a block from in to out, its words read a chunk at a time. Codes
+// are only read whole: in the middle of a block decoding stops longest bits
+// before the end of the chunk, and the bits left over move to the front.
+static bool decode_block(FILE *in, FILE *out, const block_header &block,
+                         size_t longest, bool adaptive, stream_code &code,
+                         adaptive_tree &tree, std::vector<uint64_t> &words,
+                         std::string &decoded){
+    size_t total_words = (block.bit_length + 63) / 64;
+    words.resize(STREAM_CHUNK_WORDS);
+    decoded.resize(STREAM_CHUNK_BYTES);
+
+    // Words read from the block, words in the chunk, the bit of the block
+    // the chunk starts at and the bits of its first word already used
+    size_t read = 0, held = 0;
+    uint64_t start = 0;
+    int offset = 0;
+
+    size_t done = 0;
+    while (true){
+        size_t count = std::min(words.size() - held, total_words - read);
+        if (fread(words.data() + held, 8, count, in) != count){
+            return false;
+        }
+        read += count;
+        held += count;
+
+        bool last = read == total_words;
+        uint64_t end = last ? block.bit_length - start : (uint64_t)held * 64;
+
+        bit_reader reader(words.data(), held);
+        reader.skip(offset / 2);
+        reader.skip(offset - offset / 2);
+
+        size_t used = 0;
+        while (done < block.size
+               && (last ? reader.position() < end
+                        : reader.position() + longest <= end)){
+            int symbol = adaptive ? adaptive_decode(tree, reader)
+                                  : table_decode(code.decoder, reader);
+            if (symbol < 0 || reader.position() > end){
+                return false;
+            }
+
+            decoded[used++] = (char)symbol;
+            ++done;
+            if (used == decoded.size()){
+                if (fwrite(decoded.data(), 1, used, out) != used){
+                    return false;
+                }
+                used = 0;
+            }
+        }
+        if (fwrite(decoded.data(), 1, used, out) != used){
+            return false;
+        }
+
+        // All symbols have to end exactly with the bits
+        if (last || done == block.size){
+            return last && done == block.size && reader.position() == end;
+        }
+
+        size_t keep = reader.position() / 64;
+        offset = reader.position() % 64;
+        start += (uint64_t)keep * 64;
+        std::copy(words.begin() + keep, words.begin() + held, words.begin());
+        held -= keep;
+    }
+}
+
+// Does the decompressing, in and out are open
+static bool decompress(FILE *in, FILE *out){
+    stream_header header;
+    if (fread(&header, sizeof(header), 1, in) != 1
+        || memcmp(header.magic, STREAM_MAGIC, sizeof(header.magic)) != 0
+        || header.version > STREAM_VERSION
+        || header.alphabet_size != STREAM_ALPHABET
+        || header.block_size == 0 || header.block_size > STREAM_MAX_BLOCK){
+        return false;
+    }
+
+    stream_code code;
+    if (!header.per_block && !header.adaptive
+        && !read_code(in, header.table_bytes, code)){
+        return false;
+    }
+
+    // Longest a code can get: the tree has ADAPTIVE_ALPHABET + 1 leaves, so
+    // at most ADAPTIVE_ALPHABET levels, then the raw bits of a new byte
+    size_t longest = header.adaptive ? ADAPTIVE_ALPHABET + 8 : LENGTH_LIMIT;
+    adaptive_tree tree;
+
+    std::vector<uint64_t> words;
+    std::string decoded;
+    while (true){
+        block_header block;
+        if (fread(&block, sizeof(block), 1, in) != 1){
+            return false;
+        }
+        if (block.size == 0){
+            return true;
+        }
+
+        // With the block size capped, size * longest can not overflow.
+        // Nothing is sized by the header, the words come in chunks.
+        if (block.size > header.block_size
+            || block.bit_length > block.size * longest
+            || (header.per_block && !read_code(in, block.table_bytes, code))
+            || !decode_block(in, out, block, longest, header.adaptive, code,
+                             tree, words, decoded)){
+            return false;
+        }
+    }
+}
+
+// Compresses in_path into out_path, "-" for stdin / stdout
+bool compress_file(const std::string &in_path, const std::string &out_path,
+                   const stream_options &opt){
+    FILE *in = open_file(in_path, "rb");
+    FILE *out = open_file(out_path, "wb");
+
+    bool ok = in && out && compress(in, out, opt);
+    ok = close_file(in) && ok;
+    ok = close_file(out) && ok;
+    return ok;
+}
+
+// Decompresses a file of compress_file
+bool decompress_file(const std::string &in_path, const std::string &out_path){
+    FILE *in = open_file(in_path, "rb");
+    FILE *out = open_file(out_path, "wb");
+
+    bool ok = in && out && decompress(in, out);
+    ok = close_file(in) && ok;
+    ok = close_file(out) && ok;
+    return ok;
+}
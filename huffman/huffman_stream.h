@@ -0,0 +1,60 @@
+/*-------------huffman_stream.h-----------------------------------------------//
+*
+* Purpose: header file for streaming huffman compression of files, a block
+*          at a time, so the file never has to fit in memory
+*
+*   Notes: Memory is a few blocks, whatever the file size. With one table
+*          for the whole file the input is read twice (histogram, then
+*          encoding), so it has to be a regular file. A table per block
+*          reads it once and works on pipes too, as does the adaptive
+*          mode, which sends no tables at all and learns the code as it
+*          goes (see vitter.h).
+*          Layout, host byte order:
+*              "HUFS", version (u32), block size (u64), alphabet size (u32),
+*              per block flag (u32), table bytes (u32), adaptive flag (u32),
+*              length table (whole file mode only)
+*              per block: bytes (u64), bits (u64), table bytes (u32),
+*                         unused (u32), length table, packed words
+*              a block of 0 bytes ends the file
+*
+*-----------------------------------------------------------------------------*/
+
+#ifndef HUFFMAN_STREAM_H
+#define HUFFMAN_STREAM_H
+
+#include "canonical.h"
+#include "vitter.h"
+
+// Bytes per block by default
+const size_t STREAM_BLOCK = 1 << 20;
+
+// Largest block allowed, a file declaring more is taken as damaged
+const size_t STREAM_MAX_BLOCK = (size_t)1 << 30;
+
+struct stream_options{
+    // At most STREAM_MAX_BLOCK
+    size_t block_size;
+
+    // A new code for every block instead of one for the whole file
+    bool per_block_table;
+
+    // One pass adaptive coding, no tables, per_block_table is then ignored
+    bool adaptive;
+
+    // Longest code, at most LENGTH_LIMIT
+    int limit;
+
+    stream_options() : block_size(STREAM_BLOCK), per_block_table(false),
+                       adaptive(false), limit(LENGTH_LIMIT) {}
+};
+
+// Compresses in_path into out_path, "-" for stdin / stdout
+// Returns false on read or write errors, the output is then incomplete
+bool compress_file(const std::string &in_path, const std::string &out_path,
+                   const stream_options &opt = stream_options());
+
+// Decompresses a file of compress_file
+// Returns false on read or write errors or a damaged file
+bool decompress_file(const std::string &in_path, const std::string &out_path);
+
+#endif
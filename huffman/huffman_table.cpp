@@ -0,0 +1,172 @@
+/*-------------huffman_table.cpp----------------------------------------------//
+*
+* Purpose: Decode huffman codes with lookup tables instead of a string per
+*          bit, several bits per step
+*
+*-----------------------------------------------------------------------------*/
+
+#include<algorithm>
+#include "huffman_table.h"
+
+// Creates the tables from codes indexed by symbol
+bool make_decode_table(decode_table &table,
+                       const std::vector<huffman_code> &codes){
+
+    const size_t primary_size = (size_t)1 << PRIMARY_BITS;
+
+    // Extra bits needed under every primary prefix
+    std::vector<int> sub_bits(primary_size, 0);
+    for (auto& code : codes){
+        if (code.length > MAX_CODE_LENGTH){
+            return false;
+        }
+        if (code.length > PRIMARY_BITS){
+            int extra = code.length - PRIMARY_BITS;
+            uint32_t prefix = code.bits >> extra;
+            sub_bits[prefix] = std::max(sub_bits[prefix], extra);
+        }
+    }
+
+    // Primary table first, then the secondary tables one after the other
+    table.entries.assign(primary_size, decode_entry{0, 0, 0});
+    for (size_t prefix = 0; prefix < primary_size; ++prefix){
+        if (sub_bits[prefix] > 0){
+            decode_entry &entry = table.entries[prefix];
+            entry.value = table.entries.size();
+            entry.sub_bits = sub_bits[prefix];
+            table.entries.resize(table.entries.size()
+                                 + ((size_t)1 << sub_bits[prefix]),
+                                 decode_entry{0, 0, 0});
+        }
+    }
+
+    // Every index that starts with a code gets that code's symbol
+    for (size_t symbol = 0; symbol < codes.size(); ++symbol){
+        const huffman_code &code = codes[symbol];
+        if (code.length == 0){
+            continue;
+        }
+
+        decode_entry entry{(uint32_t)symbol, (uint8_t)code.length, 0};
+        size_t first, count;
+        if (code.length <= PRIMARY_BITS){
+            count = (size_t)1 << (PRIMARY_BITS - code.length);
+            first = (size_t)code.bits << (PRIMARY_BITS - code.length);
+        }
+        else{
+            int extra = code.length - PRIMARY_BITS;
+            const decode_entry &link = table.entries[code.bits >> extra];
+            uint32_t rest = code.bits & (((uint32_t)1 << extra) - 1);
+            count = (size_t)1 << (link.sub_bits - extra);
+            first = link.value + ((size_t)rest << (link.sub_bits - extra));
+        }
+
+        std::fill(table.entries.begin() + first,
+                  table.entries.begin() + first + count, entry);
+    }
+
+    return true;
+}
+
+// Decodes all of stream, appending the symbols to decoded
+bool table_decode(const decode_table &table, const bitstream &stream,
+                  std::string &decoded){
+    return table_decode(table, stream.words.data(), stream.words.size(),
+                        stream.bit_length, decoded);
+}
+
+// Same for packed words held elsewhere (a blob or a mapped file)
+bool table_decode(const decode_table &table, const uint64_t *words,
+                  size_t num_words, size_t bit_length, std::string &decoded){
+
+    bit_reader reader(words, num_words);
+    const decode_entry *entries = table.entries.data();
+
+    // Symbols go through a small buffer, push_back per symbol is slow
+    const size_t chunk = 4096;
+    char buffer[chunk];
+    size_t count = 0;
+
+    while (reader.position() < bit_length){
+        decode_entry entry = entries[reader.peek(PRIMARY_BITS)];
+
+        // Long code, the secondary table has the rest
+        if (entry.length == 0){
+            if (entry.sub_bits == 0){
+                return false;
+            }
+            uint32_t bits = reader.peek(PRIMARY_BITS + entry.sub_bits);
+            uint32_t mask = ((uint32_t)1 << entry.sub_bits) - 1;
+            entry = entries[entry.value + (bits & mask)];
+            if (entry.length == 0){
+                return false;
+            }
+        }
+
+        buffer[count++] = (char)entry.value;
+        reader.skip(entry.length);
+
+        if (count == chunk){
+            decoded.append(buffer, count);
+            count = 0;
+        }
+    }
+    decoded.append(buffer, count);
+
+    // The last code ran past the end of the stream
+    return reader.position() == bit_length;
+}
+
+// Decodes exactly size symbols of type T into out
+template <typename T>
+static bool decode_symbols(const decode_table &table, const uint64_t *words,
+                           size_t num_words, size_t bit_length, T *out,
+                           size_t size){
+
+    bit_reader reader(words, num_words);
+    const decode_entry *entries = table.entries.data();
+
+    for (size_t i = 0; i < size; ++i){
+        decode_entry entry = entries[reader.peek(PRIMARY_BITS)];
+        if (entry.length == 0){
+            if (entry.sub_bits == 0){
+                return false;
+            }
+            uint32_t bits = reader.peek(PRIMARY_BITS + entry.sub_bits);
+            uint32_t mask = ((uint32_t)1 << entry.sub_bits) - 1;
+            entry = entries[entry.value + (bits & mask)];
+            if (entry.length == 0){
+                return false;
+            }
+        }
+
+        out[i] = (T)entry.value;
+        reader.skip(entry.length);
+    }
+
+    return reader.position() == bit_length;
+}
+
+// Decodes exactly size symbols into out, for when the count is known
+bool table_decode(const decode_table &table, const uint64_t *words,
+                  size_t num_words, size_t bit_length, char *out,
+                  size_t size){
+    return decode_symbols(table, words, num_words, bit_length, out, size);
+}
+
+// Same for 16 bit symbols
+bool table_decode(const decode_table &table, const uint64_t *words,
+                  size_t num_words, size_t bit_length, uint16_t *out,
+                  size_t size){
+    return decode_symbols(table, words, num_words, bit_length, out, size);
+}
+
+// Same for the result of two_pass_huffman
+bool table_decode(huffman_tree &tree, std::string &decoded){
+    decode_table table;
+    if (!make_decode_table(table, tree.codes)){
+        return false;
+    }
+
+    return table_decode(table, tree.packed, decoded);
+}
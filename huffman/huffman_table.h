@@ -0,0 +1,87 @@
+/*-------------huffman_table.h------------------------------------------------//
+*
+* Purpose: header file for table driven huffman decoding
+*
+*   Notes: The next PRIMARY_BITS bits of the stream index the primary table,
+*          which gives the symbol and code length straight away for codes up
+*          to PRIMARY_BITS long. Longer codes go through one secondary table
+*          per primary prefix, sized for the longest code under it.
+*          Any prefix code works, the tables do not need canonical codes.
+*
+*-----------------------------------------------------------------------------*/
+
+#ifndef HUFFMAN_TABLE_H
+#define HUFFMAN_TABLE_H
+
+#include "bitstream.h"
+#include "huffman.h"
+
+// Bits looked up at once, 2^11 entries of 8 bytes stay in L1
+const int PRIMARY_BITS = 11;
+
+// Entry of a decoding table
+// length > 0: the bits start with the code of symbol value
+// length == 0, sub_bits > 0: secondary table at entries[value], indexed by
+//                            the sub_bits bits after the primary ones
+// both 0: no code starts with these bits
+struct decode_entry{
+    uint32_t value;
+    uint8_t length;
+    uint8_t sub_bits;
+};
+
+struct decode_table{
+    // 2^PRIMARY_BITS primary entries, then the secondary tables
+    std::vector<decode_entry> entries;
+};
+
+// Creates the tables from codes indexed by symbol
+// Returns false if a code is longer than MAX_CODE_LENGTH
+bool make_decode_table(decode_table &table,
+                       const std::vector<huffman_code> &codes);
+
+// Decodes all of stream, appending the symbols to decoded
+// Returns false if the stream holds bits that are not a code
+bool table_decode(const decode_table &table, const bitstream &stream,
+                  std::string &decoded);
+
+// Same for packed words held elsewhere (a blob or a mapped file)
+bool table_decode(const decode_table &table, const uint64_t *words,
+                  size_t num_words, size_t bit_length, std::string &decoded);
+
+// Decodes exactly size symbols into out, for when the count is known
+// Returns false unless they take up exactly bit_length bits
+bool table_decode(const decode_table &table, const uint64_t *words,
+                  size_t num_words, size_t bit_length, char *out,
+                  size_t size);
+
+// Same for 16 bit symbols
+bool table_decode(const decode_table &table, const uint64_t *words,
+                  size_t num_words, size_t bit_length, uint16_t *out,
+                  size_t size);
+
+// Same for the result of two_pass_huffman
+bool table_decode(huffman_tree &tree, std::string &decoded);
+
+// Reads one symbol, -1 if the next bits are not a code. Past the end of the
+// bits zeros are read, so check the position of in against the real length.
+inline int table_decode(const decode_table &table, bit_reader &in){
+    const decode_entry *entries = table.entries.data();
+    decode_entry entry = entries[in.peek(PRIMARY_BITS)];
+    if (entry.length == 0){
+        if (entry.sub_bits == 0){
+            return -1;
+        }
+        uint32_t bits = in.peek(PRIMARY_BITS + entry.sub_bits);
+        uint32_t mask = ((uint32_t)1 << entry.sub_bits) - 1;
+        entry = entries[entry.value + (bits & mask)];
+        if (entry.length == 0){
+            return -1;
+        }
+    }
+
+    in.skip(entry.length);
+    return entry.value;
+}
+
+#endif
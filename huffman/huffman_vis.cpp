@@ -18,16 +18,38 @@
 #include <vector>
 #include <sstream>
 #include <random>
+#include <unordered_map>
 #include "huffman.h"
 
 //#define num_frames 300
 #define num_frames 300
 
+// Struct to hold positions
+struct pos{
+    double x, y;
+};
+
+// Struct for colors
+struct color{
+    double r, g, b;
+};
+
+// Where every node of the tree is drawn, kept out of the nodes themselves
+std::unordered_map<const node*, pos> node_positions;
+
+// Function to get the position of a node
+pos &ori(const node *n){
+    return node_positions[n];
+}
+
 // Struct to hold all the necessary data for animations
 struct frame{
     int res_x, res_y;
     int fps;
     int curr_frame;
+
+    // Frames hold drawing commands, they only become pixels (and are freed)
+    // when written, as everything drawn goes into every later frame too
     cairo_surface_t *frame_surface[num_frames];
     cairo_t *frame_ctx[num_frames];
     cairo_surface_t *bg_surface;
@@ -124,7 +146,7 @@ int main(){
     while (regenerated_nodes.size() > 0){
         temp_node = regenerated_nodes.top();
         regenerated_nodes.pop();
-        std::cout << temp_node->ori.x << '\t' << temp_node->ori.y << '\t' 
+        std::cout << ori(temp_node).x << '\t' << ori(temp_node).y << '\t' 
                   << temp_node-> weight << '\n'; 
     }
 */
@@ -141,9 +163,11 @@ int main(){
 // Function to initialize the frame struct
 void frame::init(){
     int line_width = 3;
+    cairo_rectangle_t extents = {0, 0, (double)res_x, (double)res_y};
     for (size_t i = 0; i < num_frames; ++i){
         frame_surface[i] = 
-            cairo_image_surface_create(CAIRO_FORMAT_ARGB32, res_x, res_y);
+            cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA,
+                                           &extents);
         frame_ctx[i] = cairo_create(frame_surface[i]);
         cairo_set_line_cap(frame_ctx[i], CAIRO_LINE_CAP_ROUND);
         cairo_set_line_width(frame_ctx[i], line_width);
@@ -164,12 +188,34 @@ void create_bg(frame &anim, int r, int g, int b){
     }
 }
 
-// Function to draw all frames in the frame struct
+// Function to paint one frame of a layer onto ctx and free it
+static void paint_and_free(cairo_t *ctx, frame &anim, int i){
+    cairo_destroy(anim.frame_ctx[i]);
+    anim.frame_ctx[i] = nullptr;
+
+    cairo_set_source_surface(ctx, anim.frame_surface[i], 0, 0);
+    cairo_paint(ctx);
+
+    cairo_surface_destroy(anim.frame_surface[i]);
+    anim.frame_surface[i] = nullptr;
+}
+
+// Function to clear the surface a frame is made in
+static void clear_surface(cairo_t *ctx){
+    cairo_set_operator(ctx, CAIRO_OPERATOR_CLEAR);
+    cairo_paint(ctx);
+    cairo_set_operator(ctx, CAIRO_OPERATOR_OVER);
+}
+
+// Function to draw all frames in the frame struct, one image at a time
 void frame::draw_frames(){
     std::string pngid, number;
+    cairo_surface_t *image = 
+        cairo_image_surface_create(CAIRO_FORMAT_ARGB32, res_x, res_y);
+    cairo_t *ctx = cairo_create(image);
     for (size_t i = 0; i < num_frames; ++i){
-        cairo_set_source_surface(frame_ctx[i], frame_surface[i], 0, 0);
-        cairo_paint(frame_ctx[i]);
+        clear_surface(ctx);
+        paint_and_free(ctx, *this, i);
 
         // Setting up number with stringstream
         std::stringstream ss;
@@ -178,9 +224,11 @@ void frame::draw_frames(){
 
         pngid = pngbase + number + ".png";
         std::cout << pngid << '\n';
-        cairo_surface_write_to_png(frame_surface[i], pngid.c_str());
+        cairo_surface_write_to_png(image, pngid.c_str());
     }
 
+    cairo_destroy(ctx);
+    cairo_surface_destroy(image);
 }
 
 // Function to set the initial variables
@@ -316,12 +364,12 @@ void draw_internal(frame &anim, double time, node_queue &regenerated_nodes,
         regenerated_nodes.pop();
 
         // Are we on an internal node?
-        if (!temp_node->key){
+        if (!is_leaf(temp_node)){
             // Left line
             animate_line(anim,anim.curr_frame,time/num_lines,
-                         temp_node->left->ori,temp_node->ori, line_clr);
+                         ori(temp_node->left),ori(temp_node), line_clr);
             animate_line(anim,anim.curr_frame-((time/num_lines) * anim.fps)+1,
-                         time/num_lines,temp_node->right->ori,temp_node->ori,
+                         time/num_lines,ori(temp_node->right),ori(temp_node),
                           line_clr);
         }
     }
@@ -344,8 +392,8 @@ node_queue regenerate_nodes(frame &anim, node *root,
 
 void draw_tree(frame &anim, int &count_x, node* root, int level, 
                node_queue &regenerated_nodes, int alphabet_size, int max_level){
-    root->ori.y = ((level - 1) * (anim.res_y - max_level * 10 )/max_level) + 5;
-    //root->ori.y = (1-(root->weight / 127.0)) * anim.res_y;
+    ori(root).y = ((level - 1) * (anim.res_y - max_level * 10 )/max_level) + 5;
+    //ori(root).y = (1-(root->weight / 127.0)) * anim.res_y;
     regenerated_nodes.push(root);
 
     if (root->right){
@@ -358,12 +406,12 @@ void draw_tree(frame &anim, int &count_x, node* root, int level,
     }
 
     if (!root->left && !root->right){
-        root->ori.x = ((((double)count_x+0.5)/(double)alphabet_size)*anim.res_x)
+        ori(root).x = ((((double)count_x+0.5)/(double)alphabet_size)*anim.res_x)
                       * 0.85 + anim.res_x * 0.0725;
         count_x += 1;
         //std::cout << "weight is: " << root->weight << '\n';
         grow_circle(anim, 0.25, 
-                    root->ori, 10 + (root->weight * 0.5), root->weight/24.0);
+                    ori(root), 10 + (root->weight * 0.5), root->weight/24.0);
 
         char test[] = { root->key, '\0' };
 
@@ -375,30 +423,34 @@ void draw_tree(frame &anim, int &count_x, node* root, int level,
                                test,
                                &textbox);
             cairo_move_to(anim.frame_ctx[j], 
-                          root->ori.x - textbox.width / 2.0,
-                          root->ori.y + textbox.height / 2.0);
+                          ori(root).x - textbox.width / 2.0,
+                          ori(root).y + textbox.height / 2.0);
             cairo_show_text(anim.frame_ctx[j], test);
             cairo_stroke(anim.frame_ctx[j]);
         }
 
-        //draw_weights(anim, root->weight, root->ori);
+        //draw_weights(anim, root->weight, ori(root));
 
     }
     else{
-        root->ori.x = (root->left->ori.x + root->right->ori.x) * 0.5;
+        ori(root).x = (ori(root->left).x + ori(root->right).x) * 0.5;
     }
         
 
 }
 
-// Function to draw all layers
+// Function to draw all layers, one image at a time
 void draw_layers(std::vector<frame> &layer){
     std::string pngid, number;
+    cairo_surface_t *image = 
+        cairo_image_surface_create(CAIRO_FORMAT_ARGB32, layer[0].res_x,
+                                   layer[0].res_y);
+    cairo_t *ctx = cairo_create(image);
     for (size_t i = 0; i < num_frames; ++i){
+        clear_surface(ctx);
+        paint_and_free(ctx, layer[0], i);
         for (size_t j = layer.size() - 1; j > 0; --j){
-            cairo_set_source_surface(layer[0].frame_ctx[i], 
-                                     layer[j].frame_surface[i], 0, 0);
-            cairo_paint(layer[0].frame_ctx[i]);
+            paint_and_free(ctx, layer[j], i);
         }
 
         // Setting up number with stringstream
@@ -408,9 +460,11 @@ void draw_layers(std::vector<frame> &layer){
 
         pngid = layer[0].pngbase + number + ".png";
         std::cout << pngid << '\n';
-        cairo_surface_write_to_png(layer[0].frame_surface[i], pngid.c_str());
+        cairo_surface_write_to_png(image, pngid.c_str());
     }
 
+    cairo_destroy(ctx);
+    cairo_surface_destroy(image);
 }
 
 // Function to draw encoding scheme
@@ -422,22 +476,22 @@ void draw_encoding(frame &anim, std::unordered_map<char, std::string> &bitmap,
 
     // Continually draw blue lines to leaf node
     if (root->right){
-        animate_line(anim, anim.curr_frame, 0.10, root->ori,  
-                     root->right->ori, clr_encoding);
+        animate_line(anim, anim.curr_frame, 0.10, ori(root),  
+                     ori(root->right), clr_encoding);
 
         draw_encoding(anim, bitmap, root->right);
     }
     if (root->left){
 
-        animate_line(anim, anim.curr_frame, 0.10, root->ori,  
-                     root->left->ori, clr_encoding);
+        animate_line(anim, anim.curr_frame, 0.10, ori(root),  
+                     ori(root->left), clr_encoding);
 
         draw_encoding(anim, bitmap, root->left);
     }
 
     // If on leaf node, drop encoding string
     if (!root->right && !root->left){
-        drop_text(anim, bitmap[root->key], root->weight, root->ori);
+        drop_text(anim, bitmap[root->key], root->weight, ori(root));
     }
 }
 
@@ -1,340 +1,286 @@
 /*-------------vitter.cpp-----------------------------------------------------//
 *
-* Purpose: Create an adaptive huffman tree, given a likelihood of receiving
-*          certain letters
+* Purpose: Adaptive huffman coding in one pass with Vitter's algorithm,
+*          the tree is updated after every symbol instead of rebuilt
 *
-*   Notes: add slide and increment function
+*   Notes: Vitter slides a node past the next block by shifting the whole
+*          block down one number. Every node of that block has the same
+*          weight and kind, so here the node just trades places with the
+*          block leader instead, which gives the same weights at every
+*          number for constant work.
 *
 *-----------------------------------------------------------------------------*/
 
-#include<iostream>
-#include<vector>
 #include<algorithm>
-#include<unordered_map>
-#include<cassert>
-#include "huffman.h"
-
-struct block{
-    int internal_start;
-    int external_start;
-  
-    block() : internal_start(-1), external_start(-1) {}
-    block(int is, int es) : internal_start(is), external_start(es) {}
-    std::vector<node *> internal, external;
-};
-
-// Function to slide and increment object along tree
-node *slideandincrement(huffman_tree &tree, node* &the_node);
-
-// Function to generate dynamic tree
-void vitter(std::string &phrase, huffman_tree &tree);
-
-// Function to test to see whether a new character is in the tree
-bool in_tree(std::vector<node*> &external, char new_key);
-
-// Function to extend NYT or 0 node
-node* extend_node(huffman_tree &tree, char new_key);
-
-// Function to swap two external nodes of same weight
-node* swap(huffman_tree &tree, char new_key);
-
-// Function to find node from its bitstring
-node* find_node(huffman_tree tree, std::string guide_to_node);
-
-// Function to add external node to external vector of nodes
-void add_external(huffman_tree tree, node *external_to_add, 
-                  std::vector<node*> &external);
-
-// Function to add internal node to internal vector of nodes
-void add_internal(huffman_tree tree, node *internal_to_add, 
-                  std::vector<node*> &internal);
-
-// Function to find the leader of a block
-// Function written by Gustorn
-// Note: requires specific ordering: [W1L, W1, W1, W2L, W2, W2, W3L, W3, W3]
-node* find_leader(const std::vector<node*>& internal, node* block_member) {
-    return *std::find_if(std::begin(internal), 
-                         std::end(internal), 
-                         [block_member](node *n) 
-                             { return n->weight == block_member->weight; });
+#include "vitter.h"
+
+// Most nodes there can be: a leaf per byte and NYT, and the internal nodes
+const int ADAPTIVE_NODES = 2 * (ADAPTIVE_ALPHABET + 1) - 1;
+
+// Starts with the NYT leaf alone as root
+adaptive_tree::adaptive_tree(){
+    nodes.reserve(ADAPTIVE_NODES);
+    node_at.reserve(ADAPTIVE_NODES);
+    pair_parent.reserve(ADAPTIVE_ALPHABET);
+    blocks.reserve(ADAPTIVE_NODES);
+    free_blocks.reserve(ADAPTIVE_NODES);
+    leaf.assign(ADAPTIVE_ALPHABET, -1);
+
+    nodes.push_back(adaptive_node{0, 0, -1, -1, 0});
+    node_at.push_back(0);
+    blocks.push_back(adaptive_block{0, true, 0, -1, -1});
+    nyt = 0;
 }
 
-// Function to find insertion index
-int find_insert_index(std::vector<node*> &internal, node* block_member);
-
-// Function to find the start of a block of a given weight
-int find_block_start(std::vector<node*> &internal, double weight);
-
-/*----------------------------------------------------------------------------//
-* MAIN
-*-----------------------------------------------------------------------------*/
-int main(){
-    std::string phrase = "Jack and Jill went up the hill to fetch a pail of water. Jack fell down and broke his crown and Jill came Tumbling after!";
-
-    huffman_tree tree = two_pass_huffman(phrase);
+// Function to find the parent of a node, -1 for the root
+static int parent_of(const adaptive_tree &tree, int id){
+    int number = tree.nodes[id].number;
+    return number == 0 ? -1 : tree.pair_parent[(number - 1) / 2];
+}
 
-    // Create a map so we may call block with integers
-    std::unordered_map<int, block> block_positions;
+// Function to find the highest number in a block
+static int block_end(const adaptive_tree &tree, int b){
+    int next = tree.blocks[b].next;
+    return next >= 0 ? tree.blocks[next].leader - 1
+                     : (int)tree.node_at.size() - 1;
+}
 
-    // find the block leaders
-    // Internal first
-    std::cout << "internal node leader weight is: " << '\n';
-    for (auto in_node : tree.internal){
-        node* leader;
-        leader = find_leader(tree.internal, in_node);
-        std::cout << leader->weight << '\n';
+// Function to add a block between prev and next
+static int new_block(adaptive_tree &tree, uint64_t weight, bool leaf,
+                     int leader, int prev, int next){
+    int b;
+    if (tree.free_blocks.empty()){
+        b = tree.blocks.size();
+        tree.blocks.push_back(adaptive_block());
     }
-
-    // External next
-    std::cout << "external node leader weight is: " << '\n';
-    for (auto ex_node : tree.external){
-        node* leader;
-        leader = find_leader(tree.external, ex_node);
-        std::cout << leader->weight << '\n';
+    else{
+        b = tree.free_blocks.back();
+        tree.free_blocks.pop_back();
     }
 
-    // Checking our in_tree command
-    bool in_tree_check = in_tree(tree.external, 'q');
-
-    std::cout << "1 if in: " << in_tree_check << '\n';
-
-    // Checking the vitter function
-    huffman_tree vitter_tree;
-    vitter_tree.root = new node();
-    vitter_tree.NYT = vitter_tree.root;
-    std::string vitter_phrase = "qqJ";
-    vitter(vitter_phrase, vitter_tree);
-    
-}
-
-// Function to slide and increment object along tree
-node *slideandincrement(huffman_tree &tree, node* &the_node){
-    int start, end;
-    // Figure out which block we need to work with.
-    // external nodes have keys associated with them
-    if (the_node->key){
-        // Work with internal node block of the_node->weight
-/*
-        start = find_block_start(tree.internal, the_node->weight);
-        end = find_insert_index(tree.internal, the_node);
-
-        std::cout << start << '\t' << end << '\n';
-*/
-        
+    tree.blocks[b] = adaptive_block{weight, leaf, leader, prev, next};
+    if (prev >= 0){
+        tree.blocks[prev].next = b;
     }
-    // Internal node
-    else{
-       // Work with external node block of the_node->weight + 1
+    if (next >= 0){
+        tree.blocks[next].prev = b;
     }
-    
-    return the_node->parent;
+    return b;
 }
 
-// Function to generate dynamic tree
-void vitter(std::string &phrase, huffman_tree &tree){
-
-    node *q;
-
-    for (size_t i = 0; i < phrase.size(); ++i){
-        // Element already in tree
-        if (in_tree(tree.external, phrase[i])){
-            std::cout << "Element already in tree." << '\n';
-            q = swap(tree, phrase[i]);
-        }
-
-        // Element must be added to tree
-        else{
-            std::cout << "Element not found in tree... adding..." << '\n';
-            q = extend_node(tree, phrase[i]);
-        }
-
-        tree.bitmap = create_bits(tree.root);
-
-        std::cout << "traversing the tree..." << '\n';
-        int count = 0;
-        while (q != tree.root){
-            std::cout << count << '\n';
-            q = slideandincrement(tree, q);
-            count++;
-        }
-        
+// Function to take an empty block out of the list
+static void remove_block(adaptive_tree &tree, int b){
+    const adaptive_block &gone = tree.blocks[b];
+    if (gone.prev >= 0){
+        tree.blocks[gone.prev].next = gone.next;
     }
-
+    if (gone.next >= 0){
+        tree.blocks[gone.next].prev = gone.prev;
+    }
+    tree.free_blocks.push_back(b);
 }
 
-// Function to test to see whether a new character is in the tree
-bool in_tree(std::vector<node*> &external, char new_key){
-    return std::find_if(std::begin(external), std::end(external),
-                        [new_key](node *n) 
-                            {return n->key == new_key;}) != std::end(external);
-
+// Function to trade the places of two nodes, subtrees and all
+static void swap_nodes(adaptive_tree &tree, int a, int b){
+    std::swap(tree.nodes[a].number, tree.nodes[b].number);
+    tree.node_at[tree.nodes[a].number] = a;
+    tree.node_at[tree.nodes[b].number] = b;
 }
 
-// Function to extend the NYT or 0 node
-// Will replace the NYT node with a new NYT node (left) and external (right)
-node* extend_node(huffman_tree &tree, char new_key){
+// Function to add one to the weight of a node, moving it where the new
+// weight belongs. Returns the next node up the path to increment.
+static int slide_and_increment(adaptive_tree &tree, int p){
 
-    node *node_parent, *node_external;
-
-    // Creating new parent node
-    node_parent = new node();
-    node_parent->weight = 0;
-    node_parent->left = tree.NYT;
-    node_parent->parent = tree.NYT->parent;
-
-    // Creating new external node with given character
-    node_external = new node();
-    node_external->weight = 0;
-    node_external->key = new_key;
-    node_external->parent = node_parent;
-
-    // placing the NYT on the left, and new external node on right
-    node_parent->right = node_external;
-
-    if (tree.NYT->parent){
-        tree.NYT->parent->left = node_parent;
+    // From the leader's place p borders the block before its own
+    int own = tree.nodes[p].block;
+    int leader = tree.node_at[tree.blocks[own].leader];
+    if (leader != p){
+        swap_nodes(tree, p, leader);
     }
 
-    tree.NYT->parent = node_parent;
-
-    // Add the new nodes to external and internal
-    add_external(tree, node_external, tree.external);
-
-    add_internal(tree, node_parent, tree.internal);
-
-    // Adding this character to the nodemap
-    tree.nodemap.emplace(new_key, node_external);
-
-    if (tree.NYT == tree.root){
-        std::cout << "NYT is root" << '\n';
-        tree.root = node_parent;
+    int old_parent = parent_of(tree, p);
+    uint64_t weight = tree.nodes[p].weight;
+    bool is_leaf = tree.nodes[p].children < 0;
+
+    // A leaf goes past the internal nodes of its weight, an internal node
+    // past the leaves of one more
+    int before = tree.blocks[own].prev;
+    bool slide = before >= 0
+                 && tree.blocks[before].leaf != is_leaf
+                 && tree.blocks[before].weight == (is_leaf ? weight
+                                                           : weight + 1);
+
+    int after = own;
+    if (tree.blocks[own].leader == block_end(tree, own)){
+        after = tree.blocks[own].next;
+        remove_block(tree, own);
+    }
+    else{
+        ++tree.blocks[own].leader;
     }
 
-    return node_parent;
-}
+    if (slide){
+        swap_nodes(tree, p, tree.node_at[tree.blocks[before].leader]);
+        ++tree.blocks[before].leader;
+        after = before;
+        before = tree.blocks[before].prev;
+    }
 
-// Function to swap two external nodes of same weight
-node* swap(huffman_tree &tree, char new_key){
-    // Find the external node to swap
-    // This is inefficient, but will probably work
-    // We will be using the bitmap to transverse the tree to get our node
-
-    std::cout << "swapping nodes..." << '\n';
-    //std::string guide_to_node = tree.bitmap[new_key];
-
-    auto it = tree.nodemap.find(new_key);
-    assert(it != tree.nodemap.end());
-/*
-    if (it == tree.nodemap.end()){
-        std::cout << "ERROR: could not find node in swap" << '\n';
-        exit(1);
+    ++tree.nodes[p].weight;
+    if (before >= 0 && tree.blocks[before].weight == weight + 1
+        && tree.blocks[before].leaf == is_leaf){
+        tree.nodes[p].block = before;
+    }
+    else{
+        tree.nodes[p].block = new_block(tree, weight + 1, is_leaf,
+                                        tree.nodes[p].number, before, after);
     }
-*/
-    node *found_node = it->second;
-    //node *found_node = find_node(tree, guide_to_node);
 
-    std::cout << "found_node weight is: " << found_node->weight << '\n';
+    // A leaf that slid has a new parent to carry the weight, an internal
+    // node left its old one a node of the new weight
+    return slide && is_leaf ? parent_of(tree, p) : old_parent;
+}
 
-    std::cout << "found node to swap. " << '\n';
-    // Do the swapping with the leader of it's block
-    node *leader = find_leader(tree.external, found_node);
+// Function to split NYT into an internal node over NYT and a leaf for
+// symbol, all of weight 0. Returns the new leaf.
+static int add_symbol(adaptive_tree &tree, unsigned char symbol){
+    int inner = tree.nodes.size();
+    int added = inner + 1;
+    int first = tree.node_at.size();
+    int pair = tree.pair_parent.size();
+    int block = tree.nodes[tree.nyt].block;
+
+    // The internal node takes the place of NYT, and NYT alone had weight 0
+    tree.nodes.push_back(adaptive_node{0, tree.nodes[tree.nyt].number, -1,
+                                       pair, block});
+    tree.nodes.push_back(adaptive_node{0, first + 1, symbol, -1, -1});
+    tree.node_at[tree.nodes[inner].number] = inner;
+    tree.node_at.push_back(tree.nyt);
+    tree.node_at.push_back(added);
+    tree.pair_parent.push_back(inner);
+    tree.nodes[tree.nyt].number = first;
+    tree.leaf[symbol] = added;
+
+    tree.blocks[block].leaf = false;
+    int leaves = new_block(tree, 0, true, first, block, -1);
+    tree.nodes[tree.nyt].block = leaves;
+    tree.nodes[added].block = leaves;
+
+    return added;
+}
 
-    std::cout << "leader found" << '\n';
+// Updates the tree for one more of symbol
+void adaptive_update(adaptive_tree &tree, unsigned char symbol){
+    int q = tree.leaf[symbol];
+    int leaf_to_increment = -1;
 
-    // children first
-    // Check whether leader and found_node are on left or right
-    if (leader->parent->left == leader){
-        leader->parent->left = found_node;
+    if (q < 0){
+        leaf_to_increment = add_symbol(tree, symbol);
+        q = parent_of(tree, leaf_to_increment);
     }
     else{
-        leader->parent->right = found_node;
+        int leader = tree.node_at[tree.blocks[tree.nodes[q].block].leader];
+        swap_nodes(tree, q, leader);
+
+        // The sibling of NYT waits for its parent, which has the same
+        // weight and would otherwise be in the way of its slide
+        int nyt_number = tree.nodes[tree.nyt].number;
+        int number = tree.nodes[q].number;
+        if (nyt_number > 0 && (number - 1) / 2 == (nyt_number - 1) / 2){
+            leaf_to_increment = q;
+            q = parent_of(tree, q);
+        }
     }
 
-    if (found_node->parent->left == found_node){
-        found_node->parent->left = leader;
+    while (q >= 0){
+        q = slide_and_increment(tree, q);
     }
-    else{
-        found_node->parent->right = leader;
+    if (leaf_to_increment >= 0){
+        slide_and_increment(tree, leaf_to_increment);
     }
-
-    std::cout << "children swapped" << '\n';
-
-    node *leader_parent = leader->parent;
-    leader->parent = found_node->parent;
-    found_node->parent = leader_parent;
-
-    std::cout << "parents swapped. " << '\n';
-
-    return found_node;
 }
 
-node* find_node(huffman_tree tree, std::string guide_to_node){
-    node *found_node = tree.root;
-
-    // Traverse tree to find node
-    for (size_t i = 0; i < guide_to_node.size(); ++i){
-        if (guide_to_node[i] == 1){
-            found_node = found_node->left;
-        }
+// Writes the code of symbol, then updates the tree
+void adaptive_encode(adaptive_tree &tree, unsigned char symbol,
+                     bit_writer &out){
+
+    // The path is found from the leaf up, so it is written backwards
+    uint8_t path[ADAPTIVE_NODES];
+    int length = 0;
+    int id = tree.leaf[symbol] >= 0 ? tree.leaf[symbol] : tree.nyt;
+    for (int number = tree.nodes[id].number; number > 0;
+         number = tree.nodes[tree.pair_parent[(number - 1) / 2]].number){
+        path[length++] = (number & 1) ^ 1;
+    }
 
-        // Only other case is "0"
-        else{
-            found_node = found_node->right;
+    while (length > 0){
+        int chunk = std::min(length, 32);
+        uint32_t bits = 0;
+        for (int i = 0; i < chunk; ++i){
+            bits = (bits << 1) | path[--length];
         }
+        out.put(bits, chunk);
     }
 
-    return found_node;
-
+    if (id == tree.nyt){
+        out.put(symbol, 8);
+    }
+    adaptive_update(tree, symbol);
 }
 
-// NOTE: A more clever inserting scheme should be implemented.
-//       Here, we are simply adding the nodes to the vector in front of the 
-//       leader of the following block (weight+1)
+// Reads one symbol, then updates the tree
+unsigned char adaptive_decode(adaptive_tree &tree, bit_reader &in){
+    int id = tree.node_at[0];
+    while (tree.nodes[id].children >= 0){
+        uint32_t bits = in.peek(32);
+        int used = 0;
+        while (used < 32 && tree.nodes[id].children >= 0){
+            int bit = (bits >> (31 - used)) & 1;
+            id = tree.node_at[2 * tree.nodes[id].children + 1 + bit];
+            ++used;
+        }
+        in.skip(used);
+    }
 
-// Function to add external node to external vector of nodes
-void add_external(huffman_tree tree, node *external_to_add, 
-                  std::vector<node*> &external){
-    int index;
-    index = find_insert_index(external, external_to_add);
+    unsigned char symbol;
+    if (id == tree.nyt){
+        symbol = in.peek(8);
+        in.skip(8);
+    }
+    else{
+        symbol = tree.nodes[id].symbol;
+    }
 
-    // Inserting into external vector
-    external.insert(external.begin() + index, external_to_add);
-    
+    adaptive_update(tree, symbol);
+    return symbol;
 }
 
-// Function to add internal node to internal vector of nodes
-void add_internal(huffman_tree tree, node *internal_to_add, 
-                  std::vector<node*> &internal){
-    int index;
-    index = find_insert_index(internal, internal_to_add);
+// Encodes size bytes at data, packed is cleared first
+void adaptive_encode(adaptive_tree &tree, const char *data, size_t size,
+                     bitstream &packed){
+    packed.words.clear();
+    packed.bit_length = 0;
 
-    // Inserting into external vector
-    internal.insert(internal.begin() + index, internal_to_add);
-
-}
-
-// Function to find insertion index
-int find_insert_index(std::vector<node*> &internal, node* block_member){
-    int index = 0;
-    for (size_t i = 0; i < internal.size(); ++i){
-        if (internal[i]->weight - 1 == block_member->weight){
-            index = i;
-            break;
-        }
+    bit_writer out(packed);
+    for (size_t i = 0; i < size; ++i){
+        adaptive_encode(tree, data[i], out);
     }
-
-    return index;
+    out.finish();
 }
 
-// Function to find the start of a block of a given weight
-int find_block_start(std::vector<node*> &internal, double weight){
-    int index = 0;
-    for (size_t i = 0; i < internal.size(); ++i){
-        if (internal[i]->weight == weight){
-            index = i;
-            break;
+// Decodes exactly size bytes into out
+bool adaptive_decode(adaptive_tree &tree, const uint64_t *words,
+                     size_t num_words, size_t bit_length, char *out,
+                     size_t size){
+    bit_reader in(words, num_words);
+    for (size_t i = 0; i < size; ++i){
+        out[i] = adaptive_decode(tree, in);
+
+        // Past the end the tree would go on learning zeros
+        if (in.position() > bit_length){
+            return false;
         }
     }
 
-    return index;
+    return in.position() == bit_length;
 }
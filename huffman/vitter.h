@@ -0,0 +1,94 @@
+/*-------------vitter.h-------------------------------------------------------//
+*
+* Purpose: header file for one pass adaptive huffman coding (Vitter's
+*          algorithm), the tree learns the weights as the symbols go by
+*
+*   Notes: Encoder and decoder start from the same empty tree and update it
+*          the same way after every symbol, so no table is ever sent. A
+*          symbol not seen before goes out as the code of the NYT (not yet
+*          transmitted) leaf followed by its 8 raw bits.
+*          Nodes are numbered from the root (0) down, with weights never
+*          rising along the numbering and, at equal weight, internal nodes
+*          before leaves. The children of a node are a pair of numbers
+*          2c + 1 (left, bit 0) and 2c + 2 (right, bit 1). Runs of equal
+*          weight and kind are blocks, kept in a list with their leaders
+*          (lowest number), so an update is constant work per level and
+*          the whole symbol costs about its code length.
+*
+*-----------------------------------------------------------------------------*/
+
+#ifndef VITTER_H
+#define VITTER_H
+
+#include "bitstream.h"
+
+// Bytes, plus nothing else, are coded
+const int ADAPTIVE_ALPHABET = 256;
+
+struct adaptive_node{
+    uint64_t weight;
+
+    // Place in the numbering, where the node sits in the tree
+    int number;
+
+    // Byte of a leaf, -1 for the NYT leaf and internal nodes
+    int symbol;
+
+    // Pair holding the children, -1 for leaves
+    int children;
+
+    int block;
+};
+
+// Run of nodes with the same weight and kind, from leader to the number
+// before the leader of next
+struct adaptive_block{
+    uint64_t weight;
+    bool leaf;
+    int leader;
+    int prev, next;
+};
+
+// Everything is sized for the full alphabet up front, so coding never
+// allocates. Nodes and blocks are indices into the vectors.
+struct adaptive_tree{
+    std::vector<adaptive_node> nodes;
+
+    // Node at every number, and the node owning every pair of children
+    std::vector<int> node_at;
+    std::vector<int> pair_parent;
+
+    // Leaf of every byte, -1 if it was not seen yet
+    std::vector<int> leaf;
+
+    std::vector<adaptive_block> blocks;
+    std::vector<int> free_blocks;
+
+    int nyt;
+
+    adaptive_tree();
+};
+
+// Updates the tree for one more of symbol
+void adaptive_update(adaptive_tree &tree, unsigned char symbol);
+
+// Writes the code of symbol, then updates the tree
+void adaptive_encode(adaptive_tree &tree, unsigned char symbol,
+                     bit_writer &out);
+
+// Reads one symbol, then updates the tree. Past the end of the bits zeros
+// are read, so check the position of in against the real length after.
+unsigned char adaptive_decode(adaptive_tree &tree, bit_reader &in);
+
+// Encodes size bytes at data, packed is cleared first. The tree carries on
+// from earlier calls, so a stream can go through a block at a time.
+void adaptive_encode(adaptive_tree &tree, const char *data, size_t size,
+                     bitstream &packed);
+
+// Decodes exactly size bytes into out, with the tree where the encoder had
+// it. Returns false if that takes more than bit_length bits.
+bool adaptive_decode(adaptive_tree &tree, const uint64_t *words,
+                     size_t num_words, size_t bit_length, char *out,
+                     size_t size);
+
+#endif
@@ -8,6 +8,7 @@
 *
 *-----------------------------------------------------------------------------*/
 
+#include <algorithm>
 #include <cairo.h>
 #include <iostream>
 #include <iomanip>
@@ -36,8 +37,13 @@ struct frame{
     int res_x, res_y;
     int fps;
     int curr_frame;
+
+    // Frames hold drawing commands, they become pixels when written
     cairo_surface_t *frame_surface[num_frames];
     cairo_t *frame_ctx[num_frames];
+
+    // Frames before this one are written and freed
+    int written;
     cairo_surface_t *bg_surface;
     cairo_t *bg_ctx;
     pos origin;
@@ -52,6 +58,10 @@ struct frame{
     // Function to draw all frames in the frame struct
     void draw_frames();
 
+    // Function to write and free the frames before last, nothing may draw
+    // into them afterwards
+    void write_frames(int last);
+
     // Function to destroy all contexts and surfaces
     void destroy_all();
 
@@ -134,9 +144,11 @@ int main(){
 // Function to initialize the frame struct
 void frame::init(int r, int g, int b){
     int line_width = 1;
+    cairo_rectangle_t extents = {0, 0, (double)res_x, (double)res_y};
     for (size_t i = 0; i < num_frames; ++i){
         frame_surface[i] = 
-            cairo_image_surface_create(CAIRO_FORMAT_ARGB32, res_x, res_y);
+            cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA,
+                                           &extents);
         frame_ctx[i] = cairo_create(frame_surface[i]);
         cairo_set_source_rgb(frame_ctx[i],(double)r, (double)g, (double)b);
         //cairo_rectangle(frame_ctx[i],0,0,res_x,res_y);
@@ -152,14 +164,32 @@ void frame::init(int r, int g, int b){
         cairo_image_surface_create(CAIRO_FORMAT_ARGB32, res_x, res_y);
     bg_ctx = cairo_create(bg_surface);
     curr_frame = 0;
+    written = 0;
 }
 
 // Function to draw all frames in the frame struct
 void frame::draw_frames(){
+    write_frames(num_frames);
+}
+
+// Function to write and free the frames before last, one image at a time
+void frame::write_frames(int last){
     std::string pngid, number;
-    for (size_t i = 0; i < num_frames; ++i){
-        cairo_set_source_surface(frame_ctx[i], frame_surface[i], 0, 0);
-        cairo_paint(frame_ctx[i]);
+    cairo_surface_t *image = 
+        cairo_image_surface_create(CAIRO_FORMAT_ARGB32, res_x, res_y);
+    cairo_t *ctx = cairo_create(image);
+    for (int i = written; i < last; ++i){
+        cairo_destroy(frame_ctx[i]);
+        frame_ctx[i] = nullptr;
+
+        cairo_set_operator(ctx, CAIRO_OPERATOR_CLEAR);
+        cairo_paint(ctx);
+        cairo_set_operator(ctx, CAIRO_OPERATOR_OVER);
+        cairo_set_source_surface(ctx, frame_surface[i], 0, 0);
+        cairo_paint(ctx);
+
+        cairo_surface_destroy(frame_surface[i]);
+        frame_surface[i] = nullptr;
 
         // Setting up number with stringstream
         std::stringstream ss;
@@ -168,9 +198,12 @@ void frame::draw_frames(){
 
         pngid = pngbase + number + ".png";
         std::cout << pngid << '\n';
-        cairo_surface_write_to_png(frame_surface[i], pngid.c_str());
+        cairo_surface_write_to_png(image, pngid.c_str());
     }
+    written = std::max(written, last);
 
+    cairo_destroy(ctx);
+    cairo_surface_destroy(image);
 }
 
 // Function to set the initial variables
@@ -473,6 +506,10 @@ void monte_carlo(frame &anim, double threshold, double box_length){
             }
             if (anim.curr_frame + 1 < num_frames){
                 anim.curr_frame++;
+
+                // Points only go into the current frame, the last one is
+                // done with
+                anim.write_frames(anim.curr_frame);
             }
             prev_print_count = count;
         }